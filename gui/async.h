@@ -0,0 +1,10 @@
+#pragma once
+
+#include <chrono>
+#include <future>
+
+// Helper for checking state of future
+template <typename T> bool IsFutureDone(std::future<T> const &future)
+{
+    return future.valid() && future.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+}
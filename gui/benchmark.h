@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "downsample.h"
+#include "time_series.h"
+
+// Settings of the headless benchmark, see --help
+struct BenchmarkConfig
+{
+    // Points per series, zero runs the GUI normally
+    size_t points = 0;
+    size_t series = 1;
+    size_t frames = 600;
+    Downsampling downsampling = Downsampling::PYRAMID;
+
+    // File the report is written to besides the log, empty for none
+    std::string report;
+};
+
+// Time range of the x axis forced onto all plots
+struct ViewRange
+{
+    double xMin = 0.0;
+    double xMax = 0.0;
+};
+
+// Random walk with one point per second ending at `end`, appended in chunks
+// so it is never held twice in memory
+static void FillSynthetic(TimeSeries &ts, size_t const points, double const end,
+                          unsigned const seed)
+{
+    auto generator = std::mt19937{seed};
+    auto step = std::normal_distribution<double>{0.0, 0.1};
+
+    auto value = 20.0;
+    auto samples = Samples{};
+    for (size_t i = 0; i < points; ++i)
+    {
+        value += step(generator);
+        samples.Push(end - static_cast<double>(points - i), value);
+        if (TimeSeries::ChunkSize == samples.Size() || i + 1 == points)
+        {
+            ts.Append(samples);
+            samples.timeStamps.clear();
+            samples.values.clear();
+        }
+    }
+}
+
+// Pan and zoom sequence over [first, last] played back by the benchmark: zoom
+// in from everything to a thousandth of it, pan across at a hundredth and zoom
+// back out, in equal thirds of the frames
+static ViewRange ScriptedView(size_t const frame, size_t const frames, double const first,
+                              double const last)
+{
+    auto const span = last - first;
+    auto const center = first + span / 2.0;
+    auto const t = static_cast<double>(frame) / static_cast<double>(std::max(frames, size_t{1}));
+
+    auto const zoomed = [&](double const fraction, double const at) {
+        auto const width = span * fraction;
+        auto const xMin = std::clamp(at - width / 2.0, first, last - width);
+        return ViewRange{xMin, xMin + width};
+    };
+
+    if (t < 1.0 / 3.0)
+    {
+        return zoomed(std::pow(1e-3, 3.0 * t), center);
+    }
+    if (t < 2.0 / 3.0)
+    {
+        auto const width = span * 1e-2;
+        auto const progress = 3.0 * t - 1.0;
+        return zoomed(1e-2, first + width / 2.0 + progress * (span - width));
+    }
+    return zoomed(std::pow(1e-3, 3.0 - 3.0 * t), center);
+}
+
+// Mean and percentiles of milliseconds as a line of text
+static std::string FormatPercentiles(char const *const name, std::vector<float> times)
+{
+    if (times.empty())
+    {
+        return std::string{name} + " ms: none\n";
+    }
+
+    std::sort(times.begin(), times.end());
+    auto const percentile = [&](double const p) {
+        auto const rank = static_cast<size_t>(p * static_cast<double>(times.size() - 1));
+        return static_cast<double>(times[rank]);
+    };
+
+    auto sum = 0.0;
+    for (auto const t : times)
+    {
+        sum += static_cast<double>(t);
+    }
+
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "%s ms: n=%zu mean=%.3f p50=%.3f p90=%.3f p99=%.3f max=%.3f\n", name,
+                  times.size(), sum / static_cast<double>(times.size()), percentile(0.5),
+                  percentile(0.9), percentile(0.99), percentile(1.0));
+    return line;
+}
+
+// Frame time percentiles in milliseconds and those of the downsampling jobs,
+// from submitting them to the worker pool until their result was ready. The
+// frames only draw the last result, so decimation on the workers does not
+// show in the frame time.
+static std::string FormatBenchmark(BenchmarkConfig const &config,
+                                   std::vector<float> const &frameTimes,
+                                   std::vector<float> const &downsampleTimes)
+{
+    if (frameTimes.empty())
+    {
+        return "No frames rendered\n";
+    }
+
+    char header[128];
+    std::snprintf(header, sizeof(header), "series=%zu points=%zu frames=%zu\n", config.series,
+                  config.points, frameTimes.size());
+    return header + FormatPercentiles("frame", frameTimes) +
+           FormatPercentiles("downsample", downsampleTimes);
+}
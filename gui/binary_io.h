@@ -0,0 +1,17 @@
+#pragma once
+
+#include <fstream>
+#include <vector>
+
+// Write the bytes of `value` as they are in memory, in native byte order
+template <typename T> static void Write(std::ofstream &file, T const value)
+{
+    file.write(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+// Write all values of `column` back to back the same way as Write
+template <typename T> static void WriteColumn(std::ofstream &file, std::vector<T> const &column)
+{
+    file.write(reinterpret_cast<char const *>(column.data()),
+               static_cast<std::streamsize>(column.size() * sizeof(T)));
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <future>
+#include <utility>
+#include <vector>
+
+#include "async.h"
+#include "merge_join.h"
+#include "thread_pool.h"
+#include "time_series.h"
+
+// Pairs the points of two series by time, e.g. temperature and humidity, and
+// tracks their Pearson correlation over a sliding time window as a series of
+// its own. Joining runs on the worker pool, the render thread only takes
+// snapshots of the points appended since the last pass, see
+// TimeSeries::GetSnapshot, and appends the pairs and coefficients a pass
+// found.
+class Correlation
+{
+  public:
+    // Pairs kept for the scatter plot, the most recent ones
+    static constexpr size_t ScatterPoints = 20000;
+
+    // Fewer pairs in the window do not give a meaningful correlation
+    static constexpr size_t MinPairs = 3;
+
+    struct Settings
+    {
+        JoinMode mode = JoinMode::NEAREST;
+        double tolerance = 1.0; // Seconds
+        double window = 60 * 60.0;
+    };
+
+    explicit Correlation(Retention const &retention) : series(retention)
+    {
+    }
+
+    // Join the points appended to `a` and `b` since the last pass. Safe to
+    // call every frame, there is at most one pass in flight. Call Reset()
+    // first when the series or the settings change.
+    void Update(ThreadPool &pool, TimeSeries const &a, TimeSeries const &b,
+                Settings const &settings)
+    {
+        if (IsFutureDone(future))
+        {
+            auto pass = future.get();
+
+            // Passes started before a reset are dropped
+            if (pass.generation == generation)
+            {
+                if (pass.fresh)
+                {
+                    series = TimeSeries{series.GetRetention()};
+                    scatter.clear();
+                }
+                series.Append(pass.samples);
+                for (auto const &pair : pass.scatter)
+                {
+                    AddScatter(scatter, pair);
+                }
+                window = std::move(pass.window);
+                cursor = pass.cursor;
+            }
+        }
+        if (future.valid() || a.IsEmpty() || b.IsEmpty())
+        {
+            return;
+        }
+
+        // Nothing appended to either series since the last pass
+        auto const appendedA = a.GetEvicted() + a.Size();
+        auto const appendedB = b.GetEvicted() + b.Size();
+        if (!fresh && appendedA == submittedA && appendedB == submittedB)
+        {
+            return;
+        }
+        submittedA = appendedA;
+        submittedB = appendedB;
+
+        // Points evicted before they were joined are skipped
+        auto const fromA = std::max(cursor.a, a.GetEvicted());
+        auto const fromB = std::max(cursor.b, b.GetEvicted());
+        auto job = Job{};
+        job.a = a.GetSnapshot(fromA - a.GetEvicted(), a.Size());
+        job.b = b.GetSnapshot(fromB - b.GetEvicted(), b.Size());
+        job.start = {fromA, fromB};
+        job.settings = settings;
+        job.window = std::move(window);
+        job.generation = generation;
+        job.fresh = fresh;
+        fresh = false;
+        future = pool.Submit([job = std::move(job)]() mutable { return Run(std::move(job)); });
+    }
+
+    // Start over. The previous result is kept until the first pass after
+    // this finished, so it can still be drawn meanwhile.
+    void Reset()
+    {
+        ++generation;
+        fresh = true;
+        cursor = {};
+        window = {};
+    }
+
+    // Correlation coefficient in [-1, 1] at the end of every window
+    TimeSeries const &GetSeries() const
+    {
+        return series;
+    }
+
+    size_t ScatterSize() const
+    {
+        return scatter.size();
+    }
+
+    // The i-th pair kept, oldest first
+    std::pair<double, double> ScatterAt(size_t const i) const
+    {
+        return scatter[i];
+    }
+
+  private:
+    using Scatter = std::deque<std::pair<double, double>>;
+
+    struct Pair
+    {
+        double t;
+        double x;
+        double y;
+    };
+
+    struct Sums
+    {
+        double x = 0.0;
+        double y = 0.0;
+        double xx = 0.0;
+        double yy = 0.0;
+        double xy = 0.0;
+
+        void Add(Pair const &p, double const sign)
+        {
+            x += sign * p.x;
+            y += sign * p.y;
+            xx += sign * p.x * p.x;
+            yy += sign * p.y * p.y;
+            xy += sign * p.x * p.y;
+        }
+    };
+
+    // Pairs within the window ending at the newest pair and their sums,
+    // handed from pass to pass
+    struct Window
+    {
+        std::deque<Pair> pairs;
+        Sums sums;
+        size_t removed = 0;
+
+        // Add the pair at `t` and drop the ones that fell out of the window
+        void Slide(double const t, double const x, double const y, double const span)
+        {
+            pairs.push_back({t, x, y});
+            sums.Add(pairs.back(), 1.0);
+            while (pairs.front().t <= t - span)
+            {
+                sums.Add(pairs.front(), -1.0);
+                pairs.pop_front();
+                ++removed;
+            }
+
+            // Subtracting leaves rounding errors behind, sum up anew once as
+            // many pairs were removed as are left, which keeps this O(1)
+            // amortized
+            if (removed > pairs.size())
+            {
+                sums = {};
+                for (auto const &p : pairs)
+                {
+                    sums.Add(p, 1.0);
+                }
+                removed = 0;
+            }
+        }
+
+        // Pearson correlation of the window, NaN if undefined
+        double Coefficient() const
+        {
+            auto const n = static_cast<double>(pairs.size());
+            auto const covariance = sums.xy / n - sums.x / n * (sums.y / n);
+            auto const varianceX = sums.xx / n - sums.x / n * (sums.x / n);
+            auto const varianceY = sums.yy / n - sums.y / n * (sums.y / n);
+
+            // Constant values leave rounding errors as variance
+            auto const constant = [](double const variance, double const squares) {
+                return variance <= 1e-12 * squares;
+            };
+            if (pairs.size() < MinPairs || constant(varianceX, sums.xx / n) ||
+                constant(varianceY, sums.yy / n))
+            {
+                return std::nan("");
+            }
+            return std::clamp(covariance / std::sqrt(varianceX * varianceY), -1.0, 1.0);
+        }
+    };
+
+    // Input of a pass, the window is empty after a reset
+    struct Job
+    {
+        TimeSeries::Snapshot a;
+        TimeSeries::Snapshot b;
+
+        // Absolute indices of the first points of the snapshots
+        JoinCursor start;
+
+        Settings settings;
+        Window window;
+        size_t generation = 0;
+        bool fresh = false;
+    };
+
+    // Output of a pass with the absolute indices the next one starts at
+    struct Pass
+    {
+        Samples samples;
+        Scatter scatter;
+        Window window;
+        JoinCursor cursor;
+        size_t generation = 0;
+        bool fresh = false;
+    };
+
+    static void AddScatter(Scatter &scatter, std::pair<double, double> const &pair)
+    {
+        if (ScatterPoints == scatter.size())
+        {
+            scatter.pop_front();
+        }
+        scatter.emplace_back(pair);
+    }
+
+    static Pass Run(Job job)
+    {
+        auto const as = job.a.ToSamples();
+        auto const bs = job.b.ToSamples();
+
+        auto pass = Pass{};
+        pass.window = std::move(job.window);
+        pass.generation = job.generation;
+        pass.fresh = job.fresh;
+
+        auto const &settings = job.settings;
+        auto i = size_t{0};
+        auto j = size_t{0};
+        MergeJoin(as, bs, settings.mode, settings.tolerance, i, j,
+                  [&](double const t, double const x, double const y) {
+                      AddScatter(pass.scatter, {x, y});
+                      pass.window.Slide(t, x, y, settings.window);
+                      if (auto const r = pass.window.Coefficient(); !std::isnan(r))
+                      {
+                          pass.samples.Push(t, r);
+                      }
+                  });
+        pass.cursor = {job.start.a + i, job.start.b + j};
+        return pass;
+    }
+
+    // Drawn by the render thread, only changed once a pass finished
+    TimeSeries series;
+    Scatter scatter;
+
+    std::future<Pass> future;
+
+    // Counts the resets, passes started before the last one are stale
+    size_t generation = 0;
+
+    // Whether the next pass starts over, its result replaces the one drawn
+    bool fresh = true;
+
+    // Where the next pass continues and its window, held by the pass in
+    // flight while there is one
+    JoinCursor cursor;
+    Window window;
+
+    // Points ever appended to a and b as of the last pass
+    size_t submittedA = 0;
+    size_t submittedB = 0;
+};
@@ -1,54 +1,460 @@
 #pragma once
 
-#include <string>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
-#include <InfluxDBFactory.h>
+#include "query_decoder.h"
 
-// Wrapper for thread safe queries to InfluxDB
+#include <cpr/cpr.h>
+
+// Wrapper for thread safe queries to InfluxDB. Queries run in parallel on a
+// small pool of independent connections, queries beyond that wait a bounded
+// time for one to become idle. Responses are requested in chunks and decoded
+// while they stream in, so they are never held as a whole.
 class Db
 {
   public:
-    ~Db()
+    static constexpr size_t PoolSize = 4;
+
+    // Queries are bounded independently of the timeout to connect, as a
+    // GROUP BY over a long range may take a while before the server sends
+    // anything. One is aborted once the server sent nothing for
+    // QueryStallTimeout, and gives up if no connection became idle within
+    // AcquireTimeout.
+    static constexpr auto QueryStallTimeout = std::chrono::seconds{120};
+    static constexpr auto AcquireTimeout = std::chrono::seconds{60};
+
+    // Latency and result size of one query, collected for the profiler
+    struct QueryStat
     {
-        // Grab a lock to make sure the Db object is not in use by another
-        // thread when destructing
-        auto const lg = std::lock_guard{m};
+        float seconds = 0.0f;
+        size_t points = 0;
+    };
+
+    // Opens a new pool of connections and swaps it in once it is ready.
+    // Queries in flight finish on the connections they started on. `url` is
+    // in the form influxdb-cxx takes, e.g. http://localhost:8086?db=iot.
+    //
+    // Every request made here is bounded by `timeout`, queries on the new
+    // connections only while connecting, see QueryStallTimeout. Setting
+    // `cancel` aborts the request in flight and no new pool is swapped in.
+    // Any failure, including a cancel, leaves the current connection as it
+    // was, so a typo in the URL does not drop a working one.
+    bool Connect(std::string const &url, std::chrono::milliseconds const timeout,
+                 std::atomic<bool> const &cancel, std::string &errMsg) noexcept
+    {
+        return Open(url, timeout, cancel, errMsg);
     }
 
-    bool Connect(std::string const &url, std::string &errMsg) noexcept
+    // Does not wait for queries in flight, safe to call every frame
+    bool IsConnected() const noexcept
     {
-        auto const lg = std::lock_guard{m};
-        try
+        return connected;
+    }
+
+    // Counts the connections made. Results of queries started under an
+    // older generation are stale.
+    size_t GetGeneration() const noexcept
+    {
+        return generation;
+    }
+
+    // Run a query and decode the response. Its latency and the number of
+    // points decoded are recorded. Setting `cancel` aborts the query at the
+    // next chunk that arrives. `ranOn` receives the generation of the
+    // connection the query actually ran on, which may be newer than the one
+    // current when it was issued.
+    bool Query(std::string const &q, std::vector<QuerySeries> &series, std::string &errMsg,
+               std::atomic<bool> const *const cancel = nullptr, size_t *const ranOn = nullptr)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        auto const start = Clock::now();
+        auto const ok = Stream(q, series, errMsg, cancel, ranOn);
+
+        auto stat = QueryStat{};
+        stat.seconds = std::chrono::duration<float>{Clock::now() - start}.count();
+        for (auto const &s : series)
+        {
+            stat.points += s.timeStamps.size();
+        }
+
+        {
+            auto const lg = std::lock_guard{statsMutex};
+            if (stats.size() < MaxStats)
+            {
+                stats.emplace_back(stat);
+            }
+        }
+        return ok;
+    }
+
+    // Bulk reads such as history pages take one of PoolSize - 1 slots for
+    // as long as they run, so one connection always stays free for polls and
+    // aggregate reads no matter how many series load at once. Returns false
+    // if all slots are taken, the read should be issued later then.
+    bool TryReserve() noexcept
+    {
+        auto current = reserved.load();
+        while (current < PoolSize - 1)
+        {
+            if (reserved.compare_exchange_weak(current, current + 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Give back a slot taken by TryReserve
+    void Release() noexcept
+    {
+        --reserved;
+    }
+
+    // Stats of the queries finished since the last call
+    std::vector<QueryStat> TakeStats()
+    {
+        auto const lg = std::lock_guard{statsMutex};
+        return std::exchange(stats, {});
+    }
+
+  private:
+    // Ping the server, create the database if it does not exist and swap in
+    // a pool of connections to it
+    bool Open(std::string const &url, std::chrono::milliseconds const timeout,
+              std::atomic<bool> const &cancel, std::string &errMsg) noexcept
+    {
+        auto const separator = url.find('?');
+        auto base = url.substr(0, separator);
+        while (!base.empty() && '/' == base.back())
+        {
+            base.pop_back();
+        }
+        auto const params = std::string::npos != separator ? url.substr(separator + 1) : "";
+
+        // Requests are aborted as soon as the attempt is cancelled, also
+        // while waiting for the server, which curl reports progress for
+        auto const abort = cpr::ProgressCallback{[&](auto &&...) { return !cancel; }};
+
+        auto ping = cpr::Session{};
+        ping.SetOption(cpr::Url{base + "/ping"});
+        ping.SetOption(cpr::Timeout{timeout});
+        ping.SetOption(abort);
+        auto const pong = ping.Get();
+        if (cancel)
+        {
+            errMsg = "Cancelled";
+            return false;
+        }
+        if (cpr::ErrorCode::OK != pong.error.code)
         {
-            db = influxdb::InfluxDBFactory::Get(url);
-            db->createDatabaseIfNotExists();
-            return true;
+            errMsg = pong.error.message;
+            return false;
         }
-        catch (influxdb::InfluxDBException const &e)
+
+        // InfluxDB answers 204, anything else that answers is not one
+        if (pong.status_code < 200 || pong.status_code >= 300)
         {
-            errMsg = e.what();
+            errMsg = "Ping failed with HTTP status " + std::to_string(pong.status_code);
             return false;
         }
+
+        // CREATE DATABASE does nothing if it exists already. influxdb-cxx
+        // would do the same, but without any timeout.
+        if (auto const name = DatabaseName(params); !name.empty())
+        {
+            auto create = cpr::Session{};
+            create.SetOption(cpr::Url{base + "/query?" + params});
+            create.SetOption(cpr::Payload{{"q", "CREATE DATABASE \"" + name + "\""}});
+            create.SetOption(cpr::Timeout{timeout});
+            create.SetOption(abort);
+            auto const response = create.Post();
+            if (cancel)
+            {
+                errMsg = "Cancelled";
+                return false;
+            }
+            if (cpr::ErrorCode::OK != response.error.code)
+            {
+                errMsg = response.error.message;
+                return false;
+            }
+            if (200 != response.status_code)
+            {
+                errMsg = "Creating database failed: " + response.text;
+                return false;
+            }
+        }
+
+        // Parameters of the URL such as the database are passed on to every
+        // query
+        auto newPool = std::make_shared<Pool>();
+        newPool->url = base + "/query?chunked=true&epoch=ns";
+        if (!params.empty())
+        {
+            newPool->url += "&" + params;
+        }
+        // Queries stream for as long as the result takes, so instead of an
+        // overall timeout they are aborted once the server stops sending
+        for (auto &connection : newPool->connections)
+        {
+            connection.session.SetOption(cpr::ConnectTimeout{timeout});
+            connection.session.SetOption(
+                cpr::LowSpeed{1, static_cast<std::int32_t>(QueryStallTimeout.count())});
+        }
+
+        // Queries still running on the previous connections are for the
+        // previous server, they are aborted. Checking `cancel` under the lock
+        // makes sure a cancelled attempt never swaps its pool in.
+        {
+            auto const lg = std::lock_guard{m};
+            if (cancel)
+            {
+                errMsg = "Cancelled";
+                return false;
+            }
+            if (nullptr != pool)
+            {
+                pool->Close();
+            }
+            newPool->generation = ++generation;
+            pool = std::move(newPool);
+            connected = true;
+        }
+        return true;
     }
 
-    bool Query(std::string const &q, std::vector<influxdb::Point> &result,
-               std::string &errMsg) noexcept
+    // Value of the db parameter of a query string such as db=iot&u=user
+    static std::string DatabaseName(std::string const &params)
     {
-        auto const lg = std::lock_guard{m};
-        try
+        auto begin = size_t{0};
+        while (begin < params.size())
         {
-            result = db->query(q);
-            return true;
+            auto end = params.find('&', begin);
+            if (std::string::npos == end)
+            {
+                end = params.size();
+            }
+            if (0 == params.compare(begin, 3, "db="))
+            {
+                return params.substr(begin + 3, end - begin - 3);
+            }
+            begin = end + 1;
         }
-        catch (influxdb::InfluxDBException const &e)
+        return {};
+    }
+
+    // Stats are dropped if nobody takes them
+    static constexpr size_t MaxStats = 1024;
+
+    // Sessions are not thread safe, each one is used by one query at a time
+    // and keeps its connection alive between queries
+    struct Connection
+    {
+        bool busy = false;
+        cpr::Session session;
+    };
+
+    struct Pool
+    {
+        // Query endpoint including all parameters but the query itself
+        std::string url;
+
+        // Set once the pool is replaced
+        std::atomic<bool> closed = false;
+
+        // Db::GetGeneration the pool was opened as
+        size_t generation = 0;
+
+        std::array<Connection, PoolSize> connections;
+
+        // Guards `busy` of the connections
+        std::mutex m;
+        std::condition_variable idle;
+
+        // Abort the queries running and wake the ones waiting
+        void Close()
+        {
+            {
+                auto const lg = std::lock_guard{m};
+                closed = true;
+            }
+            idle.notify_all();
+        }
+
+        // Take an idle connection, waiting at most AcquireTimeout for one.
+        // This parks a worker of the ThreadPool, but never longer than a
+        // query may take to answer anyway. Returns nullptr if none became
+        // idle or the pool was closed meanwhile.
+        Connection *Acquire()
+        {
+            auto lock = std::unique_lock{m};
+            auto *found = static_cast<Connection *>(nullptr);
+            idle.wait_for(lock, AcquireTimeout, [&]() {
+                for (auto &c : connections)
+                {
+                    if (!c.busy)
+                    {
+                        found = &c;
+                        return true;
+                    }
+                }
+                return closed.load();
+            });
+            if (closed || nullptr == found)
+            {
+                return nullptr;
+            }
+            found->busy = true;
+            return found;
+        }
+
+        void Release(Connection &connection)
         {
-            errMsg = e.what();
+            {
+                auto const lg = std::lock_guard{m};
+                connection.busy = false;
+            }
+            idle.notify_one();
+        }
+    };
+
+    // Hands a connection back to its pool when the query is done
+    struct Lease
+    {
+        Pool &pool;
+        Connection &connection;
+
+        Lease(Pool &pool, Connection &connection) : pool(pool), connection(connection)
+        {
+        }
+        Lease(Lease const &) = delete;
+        Lease &operator=(Lease const &) = delete;
+        ~Lease()
+        {
+            pool.Release(connection);
+        }
+    };
+
+    bool Stream(std::string const &q, std::vector<QuerySeries> &series, std::string &errMsg,
+                std::atomic<bool> const *const cancel, size_t *const ranOn)
+    {
+        auto const current = GetPool();
+        if (nullptr == current)
+        {
+            errMsg = "Not connected";
             return false;
         }
+        if (nullptr != ranOn)
+        {
+            *ranOn = current->generation;
+        }
+
+        auto *const connection = current->Acquire();
+        if (nullptr == connection)
+        {
+            errMsg = current->closed ? "Cancelled" : "All connections busy";
+            return false;
+        }
+        auto const lease = Lease{*current, *connection};
+
+        // Stale queries are aborted before decoding what arrived, and also
+        // while waiting for the server, which curl reports progress for
+        auto const cancelled = [&]() {
+            return current->closed || (nullptr != cancel && *cancel);
+        };
+
+        auto decoder = ChunkedDecoder{series};
+        auto decoded = true;
+        auto &session = connection->session;
+        session.SetOption(cpr::Url{current->url + "&q=" + UrlEncode(q)});
+        session.SetOption(cpr::WriteCallback{[&](std::string_view const data, std::intptr_t) {
+            if (cancelled())
+            {
+                return false;
+            }
+            decoded = decoder.Feed(data, errMsg);
+            return decoded;
+        }});
+        session.SetOption(cpr::ProgressCallback{[&](auto &&...) { return !cancelled(); }});
+        auto const response = session.Get();
+
+        if (!decoded)
+        {
+            return false;
+        }
+        if (cancelled())
+        {
+            errMsg = "Cancelled";
+            return false;
+        }
+        if (cpr::ErrorCode::OK != response.error.code)
+        {
+            errMsg = response.error.message;
+            return false;
+        }
+
+        // Errors reported by the database are decoded from the response
+        if (!decoder.Finish(errMsg))
+        {
+            return false;
+        }
+        if (200 != response.status_code)
+        {
+            errMsg = "HTTP status " + std::to_string(response.status_code);
+            return false;
+        }
+        return true;
     }
 
-  private:
+    // Percent encode everything but unreserved characters
+    static std::string UrlEncode(std::string const &s)
+    {
+        static constexpr char Hex[] = "0123456789ABCDEF";
+
+        auto encoded = std::string{};
+        encoded.reserve(s.size() * 3);
+        for (auto const c : s)
+        {
+            auto const u = static_cast<unsigned char>(c);
+            if (('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') ||
+                '-' == c || '_' == c || '.' == c || '~' == c)
+            {
+                encoded += c;
+            }
+            else
+            {
+                encoded += '%';
+                encoded += Hex[u >> 4];
+                encoded += Hex[u & 0xF];
+            }
+        }
+        return encoded;
+    }
+
+    std::shared_ptr<Pool> GetPool()
+    {
+        auto const lg = std::lock_guard{m};
+        return pool;
+    }
+
+    // Only guards swapping the pool, never held during a query
     std::mutex m;
-    std::shared_ptr<influxdb::InfluxDB> db;
+    std::shared_ptr<Pool> pool;
+    std::atomic<bool> connected = false;
+    std::atomic<size_t> generation = 0;
+    std::atomic<size_t> reserved = 0;
+
+    std::mutex statsMutex;
+    std::vector<QueryStat> stats;
 };
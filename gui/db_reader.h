@@ -1,89 +1,347 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <future>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "async.h"
 #include "db.h"
+#include "query_decoder.h"
+#include "series_key.h"
+#include "thread_pool.h"
+#include "time_series.h"
 
-struct TimeSeries
+// Polls a series, identified by its SeriesKey, for points newer than the last
+// one read
+class DbReader
 {
-    std::vector<double> values;
-    std::vector<double> timeStamps;
+  public:
+    DbReader(std::string const &name)
+        : name(name), selector(SeriesKey{name}.Selector()),
+          timeStamp(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::system_clock::now().time_since_epoch())
+                                    .count())
+    {
+    }
+
+    std::string const &GetName() const
+    {
+        return name;
+    }
 
-    void Append(TimeSeries const &ts)
+    // InfluxQL statement reading everything newer than the last point read
+    std::string Statement() const
     {
-        for (auto const &value : ts.values)
+        auto stream = std::stringstream{};
+        stream << "select value " << selector << "time > " << timeStamp;
+        return stream.str();
+    }
+
+    // Turn the decoded response to Statement into samples. `newest` is
+    // raised to the newest point in them, which is where the next read should
+    // start once they are accepted, see SkipTo.
+    static Samples ToSamples(QuerySeries const &series, std::int64_t &newest)
+    {
+        auto samples = Samples{};
+        for (size_t i = 0; i < series.timeStamps.size(); ++i)
         {
-            values.emplace_back(value);
+            samples.Push(NanosecondsToSeconds(series.timeStamps[i]), series.values[i]);
+            newest = std::max(newest, series.timeStamps[i]);
         }
+        return samples;
+    }
+
+    // Start the next read after `ns`, e.g. the newest point of a local
+    // cache, even if that is older than where reading stands now
+    void Resume(std::int64_t const ns)
+    {
+        timeStamp = ns;
+    }
+
+    // Start the next read after `ns`, points up to there are known already
+    void SkipTo(std::int64_t const ns)
+    {
+        timeStamp = std::max(timeStamp, ns);
+    }
+
+    static double NanosecondsToSeconds(std::int64_t const ns)
+    {
+        return static_cast<double>(ns) / 1e9;
+    }
+
+  private:
+    std::string name;
+    std::string selector;
+
+    // Nanoseconds since epoch of the newest point read so far
+    std::int64_t timeStamp;
+};
+
+// New points of several readers polled together, see ReadAll
+struct PollResult
+{
+    std::vector<Samples> samples;
 
-        for (auto const &timeStamp : ts.timeStamps)
+    // Nanoseconds since epoch of the newest point per reader, where it
+    // continues once the samples are accepted
+    std::vector<std::int64_t> newest;
+
+    // Db::GetGeneration of the connection the poll ran on
+    size_t generation = 0;
+};
+
+// Polls several measurements with a single request. The statements of all
+// readers, see DbReader::Statement, are sent together and the response is
+// split up by statement, returning the new samples in the order given. The
+// readers themselves are left alone, the caller moves them on with SkipTo
+// once it accepts the result.
+static PollResult ReadAll(Db &db, std::vector<std::string> const statements)
+{
+    auto result = PollResult{};
+    result.samples.resize(statements.size());
+    result.newest.assign(statements.size(), std::numeric_limits<std::int64_t>::min());
+    if (statements.empty())
+    {
+        return result;
+    }
+
+    auto query = std::string{};
+    for (auto const &statement : statements)
+    {
+        query += (query.empty() ? "" : "; ") + statement;
+    }
+
+    auto errMsg = std::string{};
+    auto series = std::vector<QuerySeries>{};
+    if (db.Query(query, series, errMsg, nullptr, &result.generation))
+    {
+        for (auto const &s : series)
         {
-            timeStamps.emplace_back(timeStamp);
+            auto const i = s.statement;
+            if (i >= statements.size())
+            {
+                continue;
+            }
+
+            auto samples = DbReader::ToSamples(s, result.newest[i]);
+            if (result.samples[i].IsEmpty())
+            {
+                result.samples[i] = std::move(samples);
+            }
+            else
+            {
+                // InfluxDB splits large results into several series
+                for (size_t j = 0; j < samples.Size(); ++j)
+                {
+                    result.samples[i].Push(samples.TimeStamp(j), samples.Value(j));
+                }
+            }
         }
     }
 
-    bool IsEmpty() const
+    return result;
+}
+
+// Min, max and mean of consecutive time buckets of a measurement
+struct Aggregates
+{
+    std::vector<double> timeStamps; // Center of each bucket in seconds
+    std::vector<double> mins;
+    std::vector<double> maxs;
+    std::vector<double> means;
+
+    size_t Size() const
     {
-        return timeStamps.empty();
+        return timeStamps.size();
     }
 };
 
-class DbReader
+// Reads a measurement aggregated by the database to the resolution of the
+// current view, so the amount of data transferred only depends on the plot
+// width. Results are kept until the view leaves the range that was fetched or
+// needs a different resolution. A read for a view that is left before it
+// finished is aborted right away, so fast panning does not queue up reads.
+class AggregateReader
 {
   public:
-    DbReader(std::string const &name) : name(name), timeStamp(std::chrono::system_clock::now())
+    using Clock = std::chrono::steady_clock;
+
+    // Buckets at or below this many seconds are read as raw points
+    static constexpr double RawBucket = 1.0;
+
+    // Reads that fail are retried after this many seconds, doubled for
+    // every further failure up to MaxRetryDelay
+    static constexpr double RetryDelay = 1.0;
+    static constexpr double MaxRetryDelay = 30.0;
+
+    AggregateReader(std::string const &name) : selector(SeriesKey{name}.Selector())
+    {
+    }
+
+    // Returns the buckets for the time range [xMin, xMax] on a plot that is
+    // `pixels` wide. Until the first result is ready this is empty. After a
+    // read failed the previous result is kept and no read is issued until
+    // the retry is due, even if the range changes. A read that found nothing
+    // is a result like any other, it is only read again once the range
+    // leaves it or the connection changes.
+    Aggregates const &Get(ThreadPool &pool, Db &db, double const xMin, double const xMax,
+                          size_t const pixels)
+    {
+        // Results of a previous connection belong to a different server
+        if (generation != db.GetGeneration())
+        {
+            Cancel();
+            result = {};
+            requested = {};
+            misses = 0;
+            retry = {};
+            generation = db.GetGeneration();
+        }
+
+        auto const now = Clock::now();
+        if (IsFutureDone(future))
+        {
+            auto read = future.get();
+            if (read.has_value())
+            {
+                result = std::move(*read);
+            }
+            misses = read.has_value() ? 0 : std::min(misses + 1, 16);
+            if (0 != misses)
+            {
+                auto const delay =
+                    std::min(RetryDelay * static_cast<double>(1 << (misses - 1)), MaxRetryDelay);
+                retry = now + std::chrono::duration_cast<Clock::duration>(
+                                  std::chrono::duration<double>{delay});
+            }
+        }
+
+        auto const bucket = BucketFor(xMax - xMin, pixels);
+        auto const covered = (0 == misses || future.valid()) && bucket == requested.bucket &&
+                             requested.xMin <= xMin && xMax <= requested.xMax;
+        if (!covered && now >= retry)
+        {
+            Cancel();
+
+            // Fetch a screen to either side so panning does not refetch
+            // right away
+            auto const span = xMax - xMin;
+            requested.bucket = bucket;
+            requested.xMin = std::floor((xMin - span) / bucket) * bucket;
+            requested.xMax = std::ceil((xMax + span) / bucket) * bucket;
+
+            cancel = std::make_shared<std::atomic<bool>>(false);
+            future = pool.Submit(Read, std::ref(db), selector, requested, cancel);
+        }
+
+        return result;
+    }
+
+    // Bucket width in seconds for `span` seconds spread over `pixels`,
+    // rounded up to a power of two so small zoom changes reuse the result
+    static double BucketFor(double const span, size_t const pixels)
+    {
+        auto bucket = RawBucket;
+        while (bucket * static_cast<double>(pixels) < span)
+        {
+            bucket *= 2.0;
+        }
+        return bucket;
+    }
+
+  private:
+    struct Range
+    {
+        double xMin = 0.0;
+        double xMax = 0.0;
+        double bucket = 0.0;
+    };
+
+    // Abort the read in flight, its result is never looked at
+    void Cancel()
     {
+        if (future.valid())
+        {
+            *cancel = true;
+            future = {};
+        }
     }
 
-    TimeSeries operator()(Db &db)
+    // Nothing if the query failed
+    static std::optional<Aggregates> Read(Db &db, std::string const selector, Range const range,
+                                          std::shared_ptr<std::atomic<bool>> const cancel)
     {
-        auto timeSeries = TimeSeries{};
+        auto const ns = [](double const seconds) {
+            return static_cast<std::int64_t>(seconds * 1e9);
+        };
 
-        using namespace std::chrono;
         auto stream = std::stringstream{};
-        stream << "select * from " << name << " where time > "
-               << duration_cast<nanoseconds>(timeStamp.time_since_epoch()).count();
+        auto const raw = range.bucket <= RawBucket;
+        if (raw)
+        {
+            stream << "select value ";
+        }
+        else
+        {
+            stream << "select min(value), max(value), mean(value) ";
+        }
+        stream << selector << "time >= " << ns(range.xMin) << " and time < " << ns(range.xMax);
+        if (!raw)
+        {
+            stream << " group by time(" << static_cast<std::int64_t>(range.bucket)
+                   << "s) fill(none)";
+        }
         auto const query = stream.str();
 
+        auto aggregates = Aggregates{};
         auto errMsg = std::string{};
-        auto points = std::vector<influxdb::Point>{};
-        if (db.Query(query, points, errMsg))
+        auto series = std::vector<QuerySeries>{};
+        if (!db.Query(query, series, errMsg, cancel.get()))
         {
-            for (auto point : points)
-            {
-                auto const pointTimeStamp = point.getTimestamp();
-                timeSeries.timeStamps.emplace_back(TimePointToSeconds(pointTimeStamp));
-                timeSeries.values.emplace_back(std::stod(point.getFields().substr(6)));
+            return std::nullopt;
+        }
 
-                if (timeStamp < pointTimeStamp)
-                {
-                    timeStamp = pointTimeStamp;
-                }
+        auto const offset = raw ? 0.0 : range.bucket / 2.0;
+        for (auto const &s : series)
+        {
+            for (size_t i = 0; i < s.timeStamps.size(); ++i)
+            {
+                aggregates.timeStamps.emplace_back(
+                    DbReader::NanosecondsToSeconds(s.timeStamps[i]) + offset);
             }
+
+            auto const &mins = raw ? s.values : s.mins;
+            auto const &maxs = raw ? s.values : s.maxs;
+            auto const &means = raw ? s.values : s.means;
+            aggregates.mins.insert(aggregates.mins.end(), mins.begin(), mins.end());
+            aggregates.maxs.insert(aggregates.maxs.end(), maxs.begin(), maxs.end());
+            aggregates.means.insert(aggregates.means.end(), means.begin(), means.end());
         }
 
-        return timeSeries;
+        return aggregates;
     }
 
-    template <typename T> static double TimePointToSeconds(std::chrono::time_point<T> const &tp)
-    {
-        using namespace std::chrono;
-        auto const ms = duration_cast<milliseconds>(tp.time_since_epoch()).count();
-        auto const seconds = ms / 1000.0;
-        return seconds;
-    }
+    std::string selector;
+    Range requested;
+    Aggregates result;
+    std::future<std::optional<Aggregates>> future;
 
-  private:
-    std::string name;
-    std::chrono::system_clock::time_point timeStamp;
-};
+    // Reads in a row that failed, and when to try again
+    int misses = 0;
+    Clock::time_point retry;
 
-// Helper for checking state of future
-template <typename T> bool IsFutureDone(std::future<T> const &future)
-{
-    return future.valid() && future.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
-}
+    // Shared with the read in flight
+    std::shared_ptr<std::atomic<bool>> cancel;
+
+    // Db::GetGeneration the result was read under
+    size_t generation = 0;
+};
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <future>
+#include <utility>
+#include <vector>
+
+#include "async.h"
+#include "merge_join.h"
+#include "thread_pool.h"
+#include "time_series.h"
+
+// Counts of points in a grid of equally sized bins over [xMin, xMax] x
+// [yMin, yMax]. Histograms have a single row. Rows are stored top down, the
+// way ImPlot::PlotHeatmap expects them.
+struct Bins
+{
+    size_t columns = 0;
+    size_t rows = 0;
+    double xMin = 0.0;
+    double xMax = 0.0;
+    double yMin = 0.0;
+    double yMax = 0.0;
+    std::vector<double> counts;
+
+    // Points inside of the bins and outside of them, the latter mean the
+    // range has to grow
+    size_t total = 0;
+    size_t outside = 0;
+
+    void Add(double const x, double const y)
+    {
+        auto const column = Bin(x, xMin, xMax, columns);
+        auto const row = 1 == rows ? 0 : Bin(y, yMin, yMax, rows);
+        if (column >= columns || row >= rows)
+        {
+            ++outside;
+            return;
+        }
+
+        counts[(rows - 1 - row) * columns + column] += 1.0;
+        ++total;
+    }
+
+    // Bin of `v` or `n` if it is outside of [min, max]
+    static size_t Bin(double const v, double const min, double const max, size_t const n)
+    {
+        if (!(v >= min && v <= max))
+        {
+            return n;
+        }
+        auto const bin = static_cast<size_t>((v - min) / (max - min) * static_cast<double>(n));
+        return std::min(bin, n - 1);
+    }
+};
+
+// Bins the values of a series, or the value pairs of two series at the same
+// timestamps, on the worker pool as points are appended. The render thread
+// only takes snapshots of the points appended since the last pass, see
+// TimeSeries::GetSnapshot, copying, joining and binning them all happens on
+// the worker. The bins are rebuilt from all points when new ones fall outside
+// of them or a tenth of the binned points were evicted.
+class Distribution
+{
+  public:
+    static constexpr size_t Resolution = 100;
+
+    // Bin `x` alone for a histogram or against `y` for a heatmap. Safe to
+    // call every frame, there is at most one pass in flight.
+    void Update(ThreadPool &pool, TimeSeries const &x, TimeSeries const *const y)
+    {
+        if (IsFutureDone(future))
+        {
+            auto pass = future.get();
+            bins = std::move(pass.bins);
+            nextX = pass.nextX;
+            nextY = pass.nextY;
+            built = true;
+        }
+        if (future.valid() || x.IsEmpty() || (nullptr != y && y->IsEmpty()))
+        {
+            return;
+        }
+
+        // Nothing appended to either series since the last pass
+        auto const appendedX = x.GetEvicted() + x.Size();
+        auto const appendedY = nullptr == y ? 0 : y->GetEvicted() + y->Size();
+        // Without any points binned, e.g. two series that never pair up,
+        // there is nothing that evictions could leave behind
+        auto const turnover = x.GetEvicted() - std::min(x.GetEvicted(), firstX);
+        auto const rebuild = !built || 0 != bins.outside ||
+                             (0 != bins.total && 10 * turnover > bins.total);
+        if (!rebuild && appendedX == submittedX && appendedY == submittedY)
+        {
+            return;
+        }
+        submittedX = appendedX;
+        submittedY = appendedY;
+
+        if (rebuild)
+        {
+            firstX = x.GetEvicted();
+            nextX = x.GetEvicted();
+            nextY = nullptr == y ? 0 : y->GetEvicted();
+        }
+
+        // Points evicted before they were binned are skipped
+        auto const fromX = std::max(nextX, x.GetEvicted());
+        auto job = Job{};
+        job.x = x.GetSnapshot(fromX - x.GetEvicted(), x.Size());
+        job.startX = fromX;
+        if (nullptr != y)
+        {
+            auto const fromY = std::max(nextY, y->GetEvicted());
+            job.y = y->GetSnapshot(fromY - y->GetEvicted(), y->Size());
+            job.startY = fromY;
+            job.joined = true;
+        }
+        if (!rebuild)
+        {
+            job.bins = bins;
+        }
+        future = pool.Submit(Run, std::move(job));
+    }
+
+    // Start over, e.g. for different series
+    void Reset()
+    {
+        *this = {};
+    }
+
+    // The bins of the last finished pass
+    Bins const &GetBins() const
+    {
+        return bins;
+    }
+
+  private:
+    // Input of a pass, the bins to add to are empty for a rebuild
+    struct Job
+    {
+        Bins bins;
+        TimeSeries::Snapshot x;
+        TimeSeries::Snapshot y;
+        bool joined = false;
+
+        // Absolute indices of the first points of the snapshots
+        size_t startX = 0;
+        size_t startY = 0;
+    };
+
+    // Output of a pass with the absolute indices the next one starts at
+    struct Pass
+    {
+        Bins bins;
+        size_t nextX = 0;
+        size_t nextY = 0;
+    };
+
+    static Pass Run(Job const job)
+    {
+        auto const xs = job.x.ToSamples();
+        auto const ys = job.y.ToSamples();
+
+        auto pass = Pass{job.bins, job.startX + xs.Size(), job.startY};
+        auto &bins = pass.bins;
+        if (bins.counts.empty())
+        {
+            bins.columns = Resolution;
+            bins.rows = job.joined ? Resolution : 1;
+            Extent(xs, bins.xMin, bins.xMax);
+            if (job.joined)
+            {
+                Extent(ys, bins.yMin, bins.yMax);
+            }
+            bins.counts.assign(bins.columns * bins.rows, 0.0);
+        }
+
+        if (!job.joined)
+        {
+            for (auto const value : xs.values)
+            {
+                bins.Add(value, 0.0);
+            }
+            return pass;
+        }
+
+        // Both series store milliseconds, so points of the same payload have
+        // the very same timestamp
+        auto i = size_t{0};
+        auto j = size_t{0};
+        MergeJoin(xs, ys, JoinMode::NEAREST, 0.0, i, j,
+                  [&](double, double const vx, double const vy) { bins.Add(vx, vy); });
+        pass.nextX = job.startX + i;
+        pass.nextY = job.startY + j;
+        return pass;
+    }
+
+    // Range of all values with a little room to grow
+    static void Extent(Samples const &samples, double &min, double &max)
+    {
+        if (samples.IsEmpty())
+        {
+            min = 0.0;
+            max = 1.0;
+            return;
+        }
+
+        auto const [lo, hi] = std::minmax_element(samples.values.begin(), samples.values.end());
+        auto const margin = std::max((*hi - *lo) * 0.05, 0.5);
+        min = *lo - margin;
+        max = *hi + margin;
+    }
+
+    Bins bins;
+    std::future<Pass> future;
+    bool built = false;
+
+    // Absolute index of the first point of x binned since the last rebuild
+    size_t firstX = 0;
+
+    // Absolute indices of the first points not binned yet
+    size_t nextX = 0;
+    size_t nextY = 0;
+
+    // Points ever appended to x and y as of the last pass
+    size_t submittedX = 0;
+    size_t submittedY = 0;
+};
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <future>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "async.h"
+#include "thread_pool.h"
+#include "time_series.h"
+
+enum class Downsampling
+{
+    NONE,
+    LTTB,
+    MIN_MAX,
+    PYRAMID,
+};
+
+// Copy of all points of a view, see TimeSeries::View
+template <typename View> static Samples ToSamples(View view)
+{
+    auto samples = Samples{};
+    for (size_t i = 0; i < view.Size(); ++i)
+    {
+        auto const [timeStamp, value] = view.At(i);
+        samples.Push(timeStamp, value);
+    }
+    return samples;
+}
+
+// Largest-Triangle-Three-Buckets: Keeps the first and last point and picks
+// the one point of every bucket in between that spans the largest triangle
+// with the previously picked point and the average of the next bucket.
+// The points are read through a view, only the picked ones are copied.
+template <typename View> static Samples DownsampleLttb(View view, size_t const threshold)
+{
+    auto const count = view.Size();
+    if (threshold >= count || threshold < 3)
+    {
+        return ToSamples(view);
+    }
+
+    auto result = Samples{};
+    auto const push = [&](size_t const i) {
+        auto const [timeStamp, value] = view.At(i);
+        result.Push(timeStamp, value);
+    };
+
+    // First and last point are always kept, the rest is split up evenly
+    auto const bucketSize = static_cast<double>(count - 2) / static_cast<double>(threshold - 2);
+    auto const bucketStart = [&](size_t const bucket) {
+        auto const start = std::floor(static_cast<double>(bucket) * bucketSize);
+        return std::min(static_cast<size_t>(start) + 1, count - 1);
+    };
+
+    // The point picked last
+    auto [ax, ay] = view.At(0);
+    push(0);
+
+    for (size_t bucket = 0; bucket < threshold - 2; ++bucket)
+    {
+        auto const start = bucketStart(bucket);
+        auto const end = std::max(bucketStart(bucket + 1), start + 1);
+
+        auto const nextStart = end;
+        auto const nextEnd = std::min(std::max(bucketStart(bucket + 2), nextStart + 1), count);
+
+        auto avgX = 0.0;
+        auto avgY = 0.0;
+        for (auto i = nextStart; i < nextEnd; ++i)
+        {
+            auto const [x, y] = view.At(i);
+            avgX += x;
+            avgY += y;
+        }
+        avgX /= static_cast<double>(nextEnd - nextStart);
+        avgY /= static_cast<double>(nextEnd - nextStart);
+
+        auto maxArea = -1.0;
+        auto nextX = 0.0;
+        auto nextY = 0.0;
+        for (auto i = start; i < end; ++i)
+        {
+            auto const [x, y] = view.At(i);
+            auto const area = std::abs((ax - avgX) * (y - ay) - (ax - x) * (avgY - ay));
+            if (area > maxArea)
+            {
+                maxArea = area;
+                nextX = x;
+                nextY = y;
+            }
+        }
+
+        ax = nextX;
+        ay = nextY;
+        result.Push(ax, ay);
+    }
+
+    push(count - 1);
+
+    return result;
+}
+
+// Splits the time range into `buckets` equally sized buckets (usually one per
+// pixel) and keeps the minimum and maximum of each in their original order, so
+// spikes are never lost. Like DownsampleLttb only the kept points are copied.
+template <typename View> static Samples DownsampleMinMax(View view, size_t const buckets)
+{
+    auto const count = view.Size();
+    if (2 * buckets >= count || buckets < 1)
+    {
+        return ToSamples(view);
+    }
+
+    auto result = Samples{};
+    auto const push = [&](size_t const i) {
+        auto const [timeStamp, value] = view.At(i);
+        result.Push(timeStamp, value);
+    };
+
+    auto const first = view.At(0).first;
+    auto const span = view.At(count - 1).first - first;
+    auto const bucketOf = [&](double const timeStamp) {
+        if (span <= 0.0)
+        {
+            return size_t{0};
+        }
+        auto const bucket =
+            static_cast<size_t>((timeStamp - first) / span * static_cast<double>(buckets));
+        return std::min(bucket, buckets - 1);
+    };
+
+    auto i = size_t{0};
+    while (i < count)
+    {
+        auto const [timeStamp, value] = view.At(i);
+        auto const bucket = bucketOf(timeStamp);
+        auto minIndex = i;
+        auto maxIndex = i;
+        auto min = value;
+        auto max = value;
+        for (++i; i < count; ++i)
+        {
+            auto const [t, v] = view.At(i);
+            if (bucketOf(t) != bucket)
+            {
+                break;
+            }
+            if (v < min)
+            {
+                minIndex = i;
+                min = v;
+            }
+            if (v > max)
+            {
+                maxIndex = i;
+                max = v;
+            }
+        }
+
+        push(std::min(minIndex, maxIndex));
+        if (minIndex != maxIndex)
+        {
+            push(std::max(minIndex, maxIndex));
+        }
+    }
+
+    return result;
+}
+
+template <typename View>
+static Samples Downsample(View const &view, size_t const pixels, Downsampling const method)
+{
+    switch (method)
+    {
+    case Downsampling::LTTB:
+        return DownsampleLttb(view, pixels);
+    case Downsampling::MIN_MAX:
+        return DownsampleMinMax(view, pixels);
+    case Downsampling::NONE:
+    case Downsampling::PYRAMID:
+        break;
+    }
+    return ToSamples(view);
+}
+
+// Downsamples a time series for the visible range on the worker pool.
+// The last result is kept and handed out every frame until either the view
+// or the data changes.
+class Downsampler
+{
+  public:
+    // Returns the points to draw for the time range [xMin, xMax] on a plot
+    // that is `pixels` wide. Until the first result is ready this is empty.
+    // Once a job finished, the milliseconds from submitting it until its
+    // result was ready are added to `latencies`.
+    Samples const &Get(ThreadPool &pool, TimeSeries const &ts, double const xMin,
+                       double const xMax, size_t const pixels, Downsampling const method,
+                       std::vector<float> &latencies)
+    {
+        if (IsFutureDone(future))
+        {
+            auto job = future.get();
+            result = std::move(job.samples);
+            latencies.emplace_back(job.milliseconds);
+        }
+
+        auto const request =
+            Request{xMin, xMax, pixels, ts.GetEvicted() + ts.Size(), method};
+        if (request != current && !future.valid())
+        {
+            // Only the chunks are handed over and the worker reads the points
+            // in place, just the ones picked for drawing are copied
+            auto const [first, last] = VisibleRange(ts, xMin, xMax);
+            current = request;
+            future = pool.Submit([snapshot = ts.GetSnapshot(first, last), pixels, method,
+                                  submitted = Clock::now()]() {
+                auto job = Job{Downsample(snapshot.GetView(), pixels, method)};
+                job.milliseconds =
+                    std::chrono::duration<float, std::milli>{Clock::now() - submitted}.count();
+                return job;
+            });
+        }
+
+        return result;
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job
+    {
+        Samples samples;
+        float milliseconds = 0.0f;
+    };
+
+    struct Request
+    {
+        double xMin = std::numeric_limits<double>::quiet_NaN();
+        double xMax = std::numeric_limits<double>::quiet_NaN();
+        size_t pixels = 0;
+
+        // Points ever appended, the size stays the same once the retention
+        // evicts a point for every new one
+        size_t appended = 0;
+        Downsampling method = Downsampling::NONE;
+
+        bool operator!=(Request const &other) const
+        {
+            return !(xMin == other.xMin && xMax == other.xMax && pixels == other.pixels &&
+                     appended == other.appended && method == other.method);
+        }
+    };
+
+    Request current;
+    Samples result;
+    std::future<Job> future;
+};
+
+// One Downsampler per series shared by all plots, keeping only the results of
+// the series drawn most recently so hundreds of mostly hidden series do not
+// all hold on to their downsampled points
+class DownsampleCache
+{
+  public:
+    static constexpr size_t Capacity = 64;
+
+    // Like Downsampler::Get for the series `id`
+    Samples const &Get(ThreadPool &pool, size_t const id, TimeSeries const &ts,
+                       double const xMin, double const xMax, size_t const pixels,
+                       Downsampling const method)
+    {
+        auto &entry = entries[id];
+        entry.lastUse = ++uses;
+        auto const &samples =
+            entry.downsampler.Get(pool, ts, xMin, xMax, pixels, method, latencies);
+
+        // Latencies are dropped if nobody takes them
+        if (latencies.size() > MaxLatencies)
+        {
+            latencies.erase(latencies.begin());
+        }
+        return samples;
+    }
+
+    // Milliseconds from submitting until the result was ready of the jobs
+    // finished since the last call
+    std::vector<float> TakeLatencies()
+    {
+        return std::exchange(latencies, {});
+    }
+
+    // Drop the least recently used entries beyond Capacity
+    void Trim()
+    {
+        while (entries.size() > Capacity)
+        {
+            auto oldest = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                oldest = it->second.lastUse < oldest->second.lastUse ? it : oldest;
+            }
+            entries.erase(oldest);
+        }
+    }
+
+  private:
+    struct Entry
+    {
+        Downsampler downsampler;
+        size_t lastUse = 0;
+    };
+
+    static constexpr size_t MaxLatencies = 1024;
+
+    std::unordered_map<size_t, Entry> entries;
+    size_t uses = 0;
+    std::vector<float> latencies;
+};
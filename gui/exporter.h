@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "async.h"
+#include "binary_io.h"
+#include "db.h"
+#include "query_decoder.h"
+#include "series_key.h"
+#include "thread_pool.h"
+
+// Writes a time range of several series to a file on the worker pool. The
+// range is read from the database in pages of PageSpan seconds and every page
+// is written out before the next one is read, so only one page is ever held
+// in memory no matter how large the export is.
+//
+// CSV files have the columns name,time,value like the influx CLI writes
+// them, with time in nanoseconds since epoch.
+//
+// Binary files start with the magic "IOTX", a uint32 version and a uint32
+// number of series followed by the name of every series as uint32 length and
+// bytes. Then blocks follow, each a uint32 series index and a uint32 count
+// followed by a column of count int64 nanoseconds since epoch and a column of
+// count float64 values. Numbers are written in the native byte order of the
+// machine exporting, little endian on all the GUI runs on. The version only
+// reads as 1 in the right byte order, so readers can tell.
+class Exporter
+{
+  public:
+    static constexpr double PageSpan = 60 * 60.0;
+
+    enum class Format
+    {
+        CSV,
+        BINARY,
+    };
+
+    struct Job
+    {
+        std::vector<std::string> keys;
+        double from = 0.0; // Seconds since epoch
+        double to = 0.0;
+        Format format = Format::CSV;
+        std::string path;
+    };
+
+    // Start exporting unless an export is running already
+    void Start(ThreadPool &pool, Db &db, Job const &job)
+    {
+        if (IsRunning())
+        {
+            return;
+        }
+
+        progress = std::make_shared<Progress>();
+        future = pool.Submit(Run, std::ref(db), job, progress);
+    }
+
+    bool IsRunning() const
+    {
+        return future.valid();
+    }
+
+    // Fraction of the range written so far
+    float GetProgress() const
+    {
+        return nullptr == progress ? 0.0f : progress->fraction.load();
+    }
+
+    // Stop after the page that is being read, the file is left as far as it
+    // was written
+    void Cancel()
+    {
+        if (nullptr != progress)
+        {
+            progress->cancel = true;
+        }
+    }
+
+    // Once the export finished returns true, `errMsg` tells whether it
+    // failed
+    bool TakeResult(std::string &errMsg)
+    {
+        if (!IsFutureDone(future))
+        {
+            return false;
+        }
+        errMsg = future.get();
+        return true;
+    }
+
+  private:
+    static constexpr std::uint32_t Version = 1;
+
+    // Shared with the worker, so the Exporter may go away while it runs
+    struct Progress
+    {
+        std::atomic<float> fraction = 0.0f;
+        std::atomic<bool> cancel = false;
+    };
+
+    // Returns an error message, empty on success
+    static std::string Run(Db &db, Job const job, std::shared_ptr<Progress> const progress)
+    {
+        auto file = std::ofstream{job.path, std::ios::binary | std::ios::trunc};
+        if (!file)
+        {
+            return "Failed to open " + job.path;
+        }
+
+        auto selectors = std::vector<std::string>{};
+        for (auto const &key : job.keys)
+        {
+            selectors.emplace_back(SeriesKey{key}.Selector());
+        }
+
+        if (Format::CSV == job.format)
+        {
+            file << "name,time,value\n";
+        }
+        else
+        {
+            file.write("IOTX", 4);
+            Write(file, Version);
+            Write(file, static_cast<std::uint32_t>(job.keys.size()));
+            for (auto const &key : job.keys)
+            {
+                Write(file, static_cast<std::uint32_t>(key.size()));
+                file.write(key.data(), static_cast<std::streamsize>(key.size()));
+            }
+        }
+
+        auto const ns = [](double const seconds) {
+            return static_cast<std::int64_t>(seconds * 1e9);
+        };
+
+        auto const pages = std::max(std::ceil((job.to - job.from) / PageSpan), 1.0);
+        auto line = std::string{};
+        for (auto page = 0.0; page < pages; ++page)
+        {
+            auto const from = job.from + page * PageSpan;
+            auto const to = std::min(from + PageSpan, job.to);
+
+            // The end of the range belongs to the last page
+            auto const end = page + 1.0 >= pages ? " and time <= " : " and time < ";
+
+            auto query = std::string{};
+            for (auto const &selector : selectors)
+            {
+                auto stream = std::stringstream{};
+                stream << "select value " << selector << "time >= " << ns(from) << end << ns(to);
+                query += (query.empty() ? "" : "; ") + stream.str();
+            }
+
+            auto errMsg = std::string{};
+            auto series = std::vector<QuerySeries>{};
+            if (!db.Query(query, series, errMsg, &progress->cancel))
+            {
+                return errMsg;
+            }
+
+            for (auto const &s : series)
+            {
+                if (s.statement >= job.keys.size())
+                {
+                    continue;
+                }
+
+                if (Format::CSV == job.format)
+                {
+                    auto const name = QuoteCsv(job.keys[s.statement]);
+                    for (size_t i = 0; i < s.timeStamps.size(); ++i)
+                    {
+                        line = name;
+                        AppendCsv(line, s.timeStamps[i]);
+                        AppendCsv(line, s.values[i]);
+                        line += '\n';
+                        file.write(line.data(), static_cast<std::streamsize>(line.size()));
+                    }
+                }
+                else if (!s.timeStamps.empty())
+                {
+                    Write(file, static_cast<std::uint32_t>(s.statement));
+                    Write(file, static_cast<std::uint32_t>(s.timeStamps.size()));
+                    WriteColumn(file, s.timeStamps);
+                    WriteColumn(file, s.values);
+                }
+            }
+
+            if (!file)
+            {
+                return "Failed to write to " + job.path;
+            }
+            progress->fraction = static_cast<float>((page + 1.0) / pages);
+        }
+
+        file.close();
+        return file ? std::string{} : "Failed to write to " + job.path;
+    }
+
+    // Series keys contain commas, so names are always quoted
+    static std::string QuoteCsv(std::string const &s)
+    {
+        auto quoted = std::string{"\""};
+        for (auto const c : s)
+        {
+            quoted += c;
+            if ('"' == c)
+            {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+
+    // Shortest representation that reads back to the same number
+    template <typename T> static void AppendCsv(std::string &line, T const value)
+    {
+        char buffer[32];
+        auto const [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        line += ',';
+        line.append(buffer, end);
+    }
+
+    std::future<std::string> future;
+    std::shared_ptr<Progress> progress;
+};
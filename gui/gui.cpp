@@ -1,13 +1,40 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <future>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
 
+#include "async.h"
+#include "benchmark.h"
 #include "constants.h"
+#include "correlation.h"
 #include "db.h"
 #include "db_reader.h"
 #include "defer.h"
+#include "distribution.h"
+#include "downsample.h"
+#include "exporter.h"
 #include "gol.h"
+#include "history_cache.h"
+#include "history_loader.h"
+#include "live_tail.h"
 #include "logging.h"
+#include "poll_scheduler.h"
+#include "profiler.h"
+#include "series_key.h"
+#include "statistics.h"
+#include "thread_pool.h"
 
 #include <SDL.h>
 #if !SDL_VERSION_ATLEAST(2, 0, 17)
@@ -26,43 +53,187 @@ static auto const ConnectTitle = std::string{"Connect"};
 static constexpr int Width = 800;
 static constexpr int Height = 600;
 
+// Keep a week of data by default so the GUI can run unattended
+static constexpr auto DefaultRetention = Retention{0, 7 * 24 * 60 * 60.0};
+
+// Helper for defining ImGui colors as hex RGBA
+constexpr ImVec4 RGBA(uint32_t const rgba)
+{
+    return {((rgba >> (8 * 3)) & 0xFF) / 255.0f, //
+            ((rgba >> (8 * 2)) & 0xFF) / 255.0f, //
+            ((rgba >> (8 * 1)) & 0xFF) / 255.0f, //
+            ((rgba >> (8 * 0)) & 0xFF) / 255.0f};
+}
+
+static constexpr auto TemperatureColor{RGBA(0xC44E52FF)};
+static constexpr auto HumidityColor{RGBA(0x55A868FF)};
+
+// Colors of other measurements, picked in the order they are found
+static constexpr std::array<ImVec4, 6> Palette{RGBA(0x4C72B0FF), RGBA(0xDD8452FF),
+                                               RGBA(0x8172B3FF), RGBA(0x937860FF),
+                                               RGBA(0xDA8BC3FF), RGBA(0x64B5CDFF)};
+
+// Height of a plot on the dashboard when there are more than fit on screen
+static constexpr float TileHeight = 260.0f;
+
+// Series listed by the profiler, the ones using the most memory
+static constexpr size_t MaxProfiledSeries = 20;
+
 enum class Application
 {
     VISUALISIERUNG,
     EASTER_EGG,
 };
 
+// Everything needed to read and graph one series, identified by its
+// SeriesKey
+struct Series
+{
+    Series(std::string const &key, size_t const id, std::string const &yLabel,
+           ImVec4 const &color)
+        : id(id), title(key), yLabel(yLabel), color(color), reader(key),
+          tailMeasurement(LiveTail::IsTailFed(key) ? SeriesKey{key}.GetMeasurement() : ""),
+          aggregateReader(key), cache(key), history(key)
+    {
+    }
+
+    // Index into State::series, also used with the PollScheduler and the
+    // DownsampleCache
+    size_t id;
+
+    std::string title;
+    std::string yLabel;
+    ImVec4 color;
+
+    // Whether the plot was on screen in the last frame. Hidden series are
+    // neither polled nor load their history.
+    bool visible = false;
+
+    // Time range of the plot in the last frame it was drawn, empty if never
+    double xMin = 0.0;
+    double xMax = 0.0;
+
+    // Whether the series is written by the next export
+    bool exported = false;
+
+    TimeSeries timeSeries{DefaultRetention};
+    DbReader reader;
+
+    // Measurement the live tail delivers new points of, empty for series it
+    // does not feed
+    std::string tailMeasurement;
+    TailMerger merger;
+    AggregateReader aggregateReader;
+    HistoryCache cache;
+    HistoryLoader history;
+
+    // Forget everything read so far, it belongs to the server of a previous
+    // connection. The cache is closed until opened for the next one.
+    void Reset(Retention const &retention)
+    {
+        timeSeries = TimeSeries{retention};
+        reader = DbReader{title};
+        merger = TailMerger{};
+        cache = HistoryCache{title};
+        history = HistoryLoader{title};
+    }
+};
+
+// Stage of a connection attempt, shared between the worker running it and
+// the dialog showing it
+struct ConnectProgress
+{
+    enum Stage
+    {
+        DATABASE,
+        LIVE_TAIL,
+    };
+
+    std::atomic<Stage> stage = DATABASE;
+    std::atomic<bool> cancel = false;
+};
+
 struct State
 {
     Application app = Application::VISUALISIERUNG;
     bool fitToData = true;
+
+    // Without input or new data frames are only drawn this often
+    float maxIdleSeconds = 1.0f;
+
+    bool showProfiler = false;
+    Profiler profiler;
+    bool showStatistics = false;
+    bool showExport = false;
+
+    // Histogram of one series or heatmap of two, indices into `series`
+    bool showDistribution = false;
+    int distributionX = 0;
+    int distributionY = 1;
+    Distribution distribution;
+
+    // Scatter plot and rolling correlation of two series joined by time
+    bool showCorrelation = false;
+    int correlationA = 0;
+    int correlationB = 1;
+    Correlation::Settings correlationSettings;
+    Correlation correlation{DefaultRetention};
+
     bool showConnDialog = true;
+    Downsampling downsampling = Downsampling::PYRAMID;
 
     std::string influxDbUrl{"http://localhost:8086?db=" + InfluxDbName};
+    int historyDays = 7;
     Db db;
 
-    TimeSeries temperatures;
-    DbReader temperatureReader{"temperature"};
-    std::future<TimeSeries> temperatureFuture;
-
-    TimeSeries humidities;
-    DbReader humidityReader{"humidity"};
-    std::future<TimeSeries> humidityFuture;
+    // URL of the server connected to, empty while disconnected. Caches are
+    // only opened for it.
+    std::string connectedUrl;
+
+    // Connecting runs on the worker pool, the dialog shows its progress
+    float connectTimeout = 5.0f;
+    std::future<std::string> connectFuture;
+    std::shared_ptr<ConnectProgress> connectProgress;
+    std::chrono::steady_clock::time_point connectStart;
+
+    // Optional, without it new points are polled from the database
+    std::string mqttUrl{"tcp://localhost:1883"};
+    LiveTail tail;
+
+    Retention retention = DefaultRetention;
+    std::string cacheDirectory;
+
+    // Every series known, found in the database on connect. Series are
+    // never removed, pointers to them stay valid.
+    std::vector<std::unique_ptr<Series>> series;
+    std::future<std::vector<std::string>> discoverFuture;
+
+    // Dashboard of one plot per series
+    int columns = 2;
+    std::string filter;
+    DownsampleCache downsampleCache;
+
+    // New samples of the series that were due, polled with a single query
+    bool polling = false;
+    float pollInterval = 1.0f;
+    PollScheduler scheduler;
+    std::vector<size_t> polled;
+    std::future<PollResult> pollFuture;
+
+    // Set by the benchmark to play back pan and zoom
+    std::optional<ViewRange> scriptedView;
+
+    Exporter exporter;
+    Exporter::Job exportJob{{}, 0.0, 0.0, Exporter::Format::CSV, "export.csv"};
+    bool exportVisibleRange = true;
+    int exportHours = 24;
+    std::string exportStatus;
 
     gol::Gol gol;
-};
-
-// Helper for defining ImGui colors as hex RGBA
-constexpr ImVec4 RGBA(uint32_t const rgba)
-{
-    return {((rgba >> (8 * 3)) & 0xFF) / 255.0f, //
-            ((rgba >> (8 * 2)) & 0xFF) / 255.0f, //
-            ((rgba >> (8 * 1)) & 0xFF) / 255.0f, //
-            ((rgba >> (8 * 0)) & 0xFF) / 255.0f};
-}
 
-static constexpr auto TemperatureColor{RGBA(0xC44E52FF)};
-static constexpr auto HumidityColor{RGBA(0x55A868FF)};
+    // Destroyed first, so no background work outlives the state it uses
+    ThreadPool pool;
+};
 
 // Wrapper for SDL functions returning error codes. Will log errors and crash
 // the program in case of an error.
@@ -73,142 +244,1126 @@ int SDL(int errorCode)
         LogE("SDL Error: %s", SDL_GetError());
         exit(1);
     }
-    return errorCode;
+    return errorCode;
+}
+
+// Wrapper for SDL functions returning pointers to SDL data types. Will log
+// errors and crash the program in case of an error.
+template <typename T> T *SDL(T *const ptr)
+{
+    if (nullptr == ptr)
+    {
+        LogE("SDL Error: %s", SDL_GetError());
+        exit(1);
+    }
+    return ptr;
+}
+
+// Add a series to the dashboard, its cached history is restored once
+// connected and shown
+static void AddSeries(State &state, std::string const &key)
+{
+    auto const measurement = SeriesKey{key}.GetMeasurement();
+    auto yLabel = measurement;
+    auto color = Palette[state.series.size() % Palette.size()];
+    if ("temperature" == measurement)
+    {
+        yLabel = "Temperature in °C";
+        color = TemperatureColor;
+    }
+    else if ("humidity" == measurement)
+    {
+        yLabel = "Humidity in %";
+        color = HumidityColor;
+    }
+
+    auto config = PollScheduler::Config{};
+    config.interval = state.pollInterval;
+    auto const id = state.scheduler.Add(config);
+
+    auto &series = *state.series.emplace_back(std::make_unique<Series>(key, id, yLabel, color));
+    series.timeSeries.SetRetention(state.retention);
+    if (!state.connectedUrl.empty())
+    {
+        series.cache.Open(state.cacheDirectory, state.connectedUrl, state.retention);
+    }
+    if (!series.tailMeasurement.empty())
+    {
+        state.tail.Watch(series.tailMeasurement);
+    }
+}
+
+// Drop the points of all series after a connection attempt, whether it
+// replaced the previous connection or closed it. The caches of the server
+// connected to are restored from scratch.
+static void ResetSeries(State &state)
+{
+    for (auto &series : state.series)
+    {
+        series->Reset(state.retention);
+        if (!state.connectedUrl.empty())
+        {
+            series->cache.Open(state.cacheDirectory, state.connectedUrl, state.retention);
+        }
+    }
+    state.downsampleCache = {};
+    state.distribution.Reset();
+    state.correlation.Reset();
+}
+
+// Points of a series the live tail received since the last call, nothing for
+// series it does not feed
+static Samples TakeLive(State &state, Series const &series)
+{
+    return series.tailMeasurement.empty() ? Samples{} : state.tail.Take(series.tailMeasurement);
+}
+
+// Keys of all series in the database
+static std::vector<std::string> DiscoverSeries(Db &db)
+{
+    auto keys = std::vector<std::string>{};
+    auto errMsg = std::string{};
+    auto series = std::vector<QuerySeries>{};
+    if (db.Query("show series", series, errMsg))
+    {
+        for (auto const &s : series)
+        {
+            keys.insert(keys.end(), s.keys.begin(), s.keys.end());
+        }
+    }
+    return keys;
+}
+
+// Whether a series may be polled from the database. Hidden series are not,
+// the ones still loading their history do not know where to start reading.
+static bool IsPolled(Series const &series)
+{
+    return series.visible && series.history.IsLoaded();
+}
+
+// Whether a series is polled from the database now. Series the live tail is
+// in sync for do not need the database.
+static bool WantsPoll(Series const &series)
+{
+    return IsPolled(series) && series.merger.NeedsPoll();
+}
+
+// Poll the series that are due for new data on the worker pool
+static void StartPoll(State &state)
+{
+    auto const due = state.scheduler.Due(PollScheduler::Clock::now());
+    if (due.empty())
+    {
+        return;
+    }
+
+    auto statements = std::vector<std::string>{};
+    state.polled.clear();
+    for (auto const id : due)
+    {
+        if (WantsPoll(*state.series[id]))
+        {
+            statements.emplace_back(state.series[id]->reader.Statement());
+            state.polled.emplace_back(id);
+        }
+    }
+    if (statements.empty())
+    {
+        return;
+    }
+
+    state.pollFuture = state.pool.Submit(ReadAll, std::ref(state.db), statements);
+}
+
+// Connect to the database and subscribe to the live tail, each step giving up
+// after `timeout` or as soon as the attempt is cancelled. The tail is
+// optional, so only failing to connect to the database is returned as an
+// error message.
+static std::string Connect(Db &db, LiveTail &tail, std::string const dbUrl,
+                           std::string const mqttUrl, std::chrono::milliseconds const timeout,
+                           std::shared_ptr<ConnectProgress> const progress)
+{
+    auto errMsg = std::string{};
+    if (!db.Connect(dbUrl, timeout, progress->cancel, errMsg))
+    {
+        return errMsg.empty() ? "Unknown error" : errMsg;
+    }
+
+    if (!mqttUrl.empty() && !tail.IsConnected() && !progress->cancel)
+    {
+        progress->stage = ConnectProgress::LIVE_TAIL;
+        if (!tail.Connect(mqttUrl, timeout, progress->cancel, errMsg))
+        {
+            LogE("Failed to subscribe to %s, polling the database only: %s", mqttUrl.c_str(),
+                 errMsg.c_str());
+        }
+    }
+    return {};
+}
+
+// Draw modal user dialog for connecting to the InfluxDB instance. Connecting
+// happens in the background, the dialog only shows how far it got.
+static void DrawConnectDialog(State &state)
+{
+    static auto errorMsg = std::string{};
+    if (state.showConnDialog)
+    {
+        ImGui::OpenPopup("Connect");
+    }
+
+    if (ImGui::BeginPopupModal("Connect"))
+    {
+        auto const connecting = state.connectFuture.valid();
+        ImGui::BeginDisabled(connecting);
+        ImGui::InputText("InfluxDB URL", &state.influxDbUrl);
+        ImGui::InputText("MQTT URL", &state.mqttUrl);
+        ImGui::InputInt("History in days", &state.historyDays);
+        ImGui::SliderFloat("Timeout", &state.connectTimeout, 1.0f, 60.0f, "%.0f s");
+
+        if (ImGui::Button("Connect"))
+        {
+            LogI("Trying to connect to '%s'", state.influxDbUrl.c_str());
+            errorMsg.clear();
+            auto const timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::duration<float>{state.connectTimeout});
+            state.connectProgress = std::make_shared<ConnectProgress>();
+            state.connectStart = std::chrono::steady_clock::now();
+            state.connectFuture =
+                state.pool.Submit(Connect, std::ref(state.db), std::ref(state.tail),
+                                  state.influxDbUrl, state.mqttUrl, timeout, state.connectProgress);
+        }
+        ImGui::EndDisabled();
+
+        // An attempt in flight stops at its next step and is waited for, so
+        // there is never more than one at a time
+        ImGui::SameLine();
+        ImGui::BeginDisabled(connecting && state.connectProgress->cancel);
+        if (ImGui::Button("Cancel"))
+        {
+            if (connecting)
+            {
+                state.connectProgress->cancel = true;
+            }
+            else
+            {
+                state.showConnDialog = false;
+                ImGui::CloseCurrentPopup();
+            }
+        }
+        ImGui::EndDisabled();
+
+        if (connecting)
+        {
+            auto const elapsed = std::chrono::duration<float>{std::chrono::steady_clock::now() -
+                                                              state.connectStart};
+            auto const stage = state.connectProgress->cancel ? "Cancelling"
+                               : ConnectProgress::DATABASE == state.connectProgress->stage
+                                   ? "Connecting to InfluxDB"
+                                   : "Subscribing to MQTT";
+            ImGui::ProgressBar(std::min(elapsed.count() / state.connectTimeout, 1.0f), {-1, 0},
+                               stage);
+        }
+
+        if (IsFutureDone(state.connectFuture))
+        {
+            errorMsg = state.connectFuture.get();
+
+            // A failed attempt leaves the previous connection and the series
+            // read from it as they were
+            if (errorMsg.empty())
+            {
+                // The URL could not be edited while connecting
+                state.connectedUrl = state.influxDbUrl;
+                ResetSeries(state);
+                state.polling = true;
+                state.discoverFuture = state.pool.Submit(DiscoverSeries, std::ref(state.db));
+
+                state.showConnDialog = false;
+                ImGui::CloseCurrentPopup();
+                LogI("Connected");
+            }
+            else
+            {
+                LogE("Failed to connect to %s: %s", state.influxDbUrl.c_str(), errorMsg.c_str());
+            }
+        }
+
+        if (!errorMsg.empty())
+        {
+            ImGui::TextWrapped("Failed to connect: %s", errorMsg.c_str());
+        }
+
+        ImGui::EndPopup();
+    }
+}
+
+// Draw the main window menu
+static void DrawMainMenuBar(State &state)
+{
+    if (ImGui::BeginMainMenuBar())
+    {
+        if (ImGui::BeginMenu("File"))
+        {
+            if (ImGui::MenuItem("Connect to database"))
+            {
+                state.showConnDialog = true;
+            }
+
+            if (ImGui::MenuItem("Exit"))
+            {
+                auto event = SDL_Event{SDL_QUIT};
+                SDL_PushEvent(&event);
+            }
+            ImGui::EndMenu();
+        }
+
+        if (ImGui::BeginMenu("View"))
+        {
+            ImGui::Checkbox("Fit to data", &state.fitToData);
+            ImGui::SliderFloat("Max idle interval", &state.maxIdleSeconds, 0.1f, 10.0f, "%.1f s");
+            ImGui::Checkbox("Profiler", &state.showProfiler);
+            ImGui::Checkbox("Statistics", &state.showStatistics);
+            ImGui::Checkbox("Export", &state.showExport);
+            ImGui::Checkbox("Distribution", &state.showDistribution);
+            ImGui::Checkbox("Correlation", &state.showCorrelation);
+
+            if (ImGui::BeginMenu("Downsampling"))
+            {
+                if (ImGui::MenuItem("None", nullptr, Downsampling::NONE == state.downsampling))
+                {
+                    state.downsampling = Downsampling::NONE;
+                }
+                if (ImGui::MenuItem("LTTB", nullptr, Downsampling::LTTB == state.downsampling))
+                {
+                    state.downsampling = Downsampling::LTTB;
+                }
+                if (ImGui::MenuItem("Min/Max", nullptr,
+                                    Downsampling::MIN_MAX == state.downsampling))
+                {
+                    state.downsampling = Downsampling::MIN_MAX;
+                }
+                if (ImGui::MenuItem("Min/Max pyramid", nullptr,
+                                    Downsampling::PYRAMID == state.downsampling))
+                {
+                    state.downsampling = Downsampling::PYRAMID;
+                }
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("Polling", state.polling))
+            {
+                if (ImGui::SliderFloat("Interval", &state.pollInterval, 0.1f, 60.0f, "%.1f s"))
+                {
+                    for (size_t id = 0; id < state.scheduler.Size(); ++id)
+                    {
+                        state.scheduler.GetConfig(id).interval = state.pollInterval;
+                    }
+                }
+                ImGui::EndMenu();
+            }
+
+            if (ImGui::BeginMenu("Retention"))
+            {
+                auto maxPoints = static_cast<int>(state.retention.maxPoints);
+                auto maxAgeHours = state.retention.maxAge / 3600.0;
+                auto changed = false;
+
+                // Only apply on enter, intermediate input could drop data
+                static constexpr auto inputFlags = ImGuiInputTextFlags_EnterReturnsTrue;
+
+                ImGui::TextUnformatted("0 keeps everything");
+                if (ImGui::InputInt("Max points", &maxPoints, 1000, 100000, inputFlags))
+                {
+                    state.retention.maxPoints = static_cast<size_t>(std::max(maxPoints, 0));
+                    changed = true;
+                }
+                if (ImGui::InputDouble("Max age in hours", &maxAgeHours, 1.0, 24.0, "%.1f",
+                                      inputFlags))
+                {
+                    state.retention.maxAge = std::max(maxAgeHours, 0.0) * 3600.0;
+                    changed = true;
+                }
+
+                if (changed)
+                {
+                    for (auto &series : state.series)
+                    {
+                        series->timeSeries.SetRetention(state.retention);
+                    }
+                }
+                ImGui::EndMenu();
+            }
+
+            ImGui::EndMenu();
+        }
+        ImGui::EndMainMenuBar();
+    }
+}
+
+// ImPlot getter reading points straight out of a TimeSeries::View or
+// Samples::View
+template <typename View> static ImPlotPoint GetViewPoint(int const idx, void *const data)
+{
+    auto const [timeStamp, value] = static_cast<View *>(data)->At(static_cast<size_t>(idx));
+    return {timeStamp, value};
+}
+
+// Plot the points of a view as a line without copying them
+template <typename View> static void PlotView(std::string const &title, View view)
+{
+    ImPlot::PlotLineG(title.c_str(), GetViewPoint<View>, &view, static_cast<int>(view.Size()));
+}
+
+// Graph blocks of points as a shaded min/max band with their mean as a line
+static void PlotBand(std::string const &title, double const *timeStamps, double const *mins,
+                     double const *maxs, double const *means, size_t const count,
+                     ImVec4 const &color)
+{
+    ImPlot::SetNextFillStyle(color, 0.25f);
+    ImPlot::PlotShaded(title.c_str(), timeStamps, mins, maxs, static_cast<int>(count));
+
+    ImPlot::SetNextLineStyle(color);
+    ImPlot::SetNextMarkerStyle(ImPlotMarker_None);
+    ImPlot::PlotLine(title.c_str(), timeStamps, means, static_cast<int>(count));
+}
+
+// Graph the pyramid level of a time series that fits into the plot width
+static void DrawPyramid(std::string const &title, TimeSeries const &timeSeries,
+                        double const xMin, double const xMax, size_t const pixels,
+                        ImVec4 const &color)
+{
+    auto const [first, last] = VisibleRange(timeSeries, xMin, xMax);
+    auto const &pyramid = timeSeries.GetPyramid();
+    auto const k = pyramid.LevelFor(last - first, pixels);
+    if (0 == k)
+    {
+        PlotView(title, timeSeries.GetView(first, last));
+        return;
+    }
+
+    // Blocks of evicted points may linger at the front of a level
+    auto const &level = pyramid.GetLevel(k);
+    auto const size = Pyramid::BlockSize(k);
+    auto const evicted = timeSeries.GetEvicted();
+    auto const begin = std::max((evicted + first) / size, level.firstBlock + level.dead);
+    auto const end = std::min((evicted + last - 1) / size + 1, level.firstBlock + level.Size());
+
+    // Only about as many blocks as the plot is wide, so they are gathered
+    // with their timestamps every frame
+    auto blocks = Aggregates{};
+    for (auto block = begin; block < end; ++block)
+    {
+        auto const i = block - level.firstBlock;
+        blocks.timeStamps.emplace_back(timeSeries.BlockTimeStamp(k, block));
+        blocks.mins.emplace_back(static_cast<double>(level.mins[i]));
+        blocks.maxs.emplace_back(static_cast<double>(level.maxs[i]));
+        blocks.means.emplace_back(static_cast<double>(level.means[i]));
+    }
+
+    PlotBand(title, blocks.timeStamps.data(), blocks.mins.data(), blocks.maxs.data(),
+             blocks.means.data(), blocks.Size(), color);
+}
+
+// Graph the part of the local time series inside of [xMin, xMax]. Only the
+// visible points are handed to ImPlot, so zooming in costs the same no matter
+// how long the history is. Ranges with more points than the plot is wide are
+// downsampled first.
+static void DrawLocal(Series &series, ThreadPool &pool, DownsampleCache &downsampleCache,
+                      double const xMin, double const xMax, size_t const pixels,
+                      Downsampling const downsampling)
+{
+    auto const &timeSeries = series.timeSeries;
+    auto const [first, last] = VisibleRange(timeSeries, xMin, xMax);
+    if (Downsampling::NONE == downsampling || last - first <= 2 * pixels)
+    {
+        PlotView(series.title, timeSeries.GetView(first, last));
+    }
+    else if (Downsampling::PYRAMID == downsampling)
+    {
+        DrawPyramid(series.title, timeSeries, xMin, xMax, pixels, series.color);
+    }
+    else
+    {
+        auto const &points = downsampleCache.Get(pool, series.id, timeSeries, xMin, xMax, pixels,
+                                                 downsampling);
+        PlotView(series.title, points.GetView(0, points.Size()));
+    }
+}
+
+// Graph time series for a measurement. Ranges before the first point that is
+// held locally are aggregated by the database to the resolution of the plot.
+static void DrawTimeSeries(State &state, Series &series, ImVec2 const &size)
+{
+    auto &db = state.db;
+    auto &pool = state.pool;
+    auto const downsampling = state.downsampling;
+    auto const fitToData = state.fitToData;
+
+    auto const &timeSeries = series.timeSeries;
+    if (state.scriptedView)
+    {
+        ImPlot::SetNextAxisLimits(ImAxis_X1, state.scriptedView->xMin, state.scriptedView->xMax,
+                                  ImPlotCond_Always);
+        ImPlot::SetNextAxisToFit(ImAxis_Y1);
+    }
+    else if (fitToData && !timeSeries.IsEmpty())
+    {
+        ImPlot::SetNextAxesToFit();
+    }
+
+    if (ImPlot::BeginPlot(series.title.c_str(), size))
+    {
+        ImPlot::SetupAxes("Timestamp", series.yLabel.c_str());
+        ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Time);
+
+        auto &style = ImPlot::GetStyle();
+        style.UseLocalTime = true;
+        style.Marker = ImPlotMarker_Circle;
+
+        ImPlot::SetNextLineStyle(series.color);
+
+        // Fitting to data needs the whole series, the current limits would
+        // only ever fit to what is already visible
+        auto const pixels = static_cast<size_t>(std::max(ImPlot::GetPlotSize().x, 1.0f));
+        auto const limits = ImPlot::GetPlotLimits();
+        auto xMin = limits.X.Min;
+        auto xMax = limits.X.Max;
+        if (fitToData && !timeSeries.IsEmpty())
+        {
+            xMin = timeSeries.TimeStamp(0);
+            xMax = timeSeries.TimeStamp(timeSeries.Size() - 1);
+        }
+
+        series.xMin = xMin;
+        series.xMax = xMax;
+
+        auto const firstLocal = timeSeries.IsEmpty() ? std::numeric_limits<double>::infinity()
+                                                     : timeSeries.TimeStamp(0);
+        if (xMin < firstLocal && db.IsConnected())
+        {
+            auto const &aggregates = series.aggregateReader.Get(pool, db, xMin, xMax, pixels);
+            auto const [begin, end] = VisibleRange(aggregates.timeStamps, xMin, firstLocal);
+            PlotBand(series.title, aggregates.timeStamps.data() + begin,
+                     aggregates.mins.data() + begin, aggregates.maxs.data() + begin,
+                     aggregates.means.data() + begin, end - begin, series.color);
+        }
+
+        DrawLocal(series, pool, state.downsampleCache, std::max(xMin, firstLocal), xMax, pixels,
+                  downsampling);
+
+        series.history.ForEachWaiting([&](Samples const &page) {
+            auto const [begin, end] = VisibleRange(page.timeStamps, xMin, xMax);
+            ImPlot::SetNextLineStyle(series.color);
+            PlotView(series.title, page.GetView(begin, end));
+        });
+
+        ImPlot::EndPlot();
+    }
+}
+
+// Update time data from the live tail and the database
+static void UpdateData(State &state)
+{
+    if (IsFutureDone(state.discoverFuture))
+    {
+        for (auto const &key : state.discoverFuture.get())
+        {
+            auto const known =
+                std::any_of(state.series.begin(), state.series.end(),
+                            [&](auto const &series) { return key == series->title; });
+            if (!known)
+            {
+                AddSeries(state, key);
+            }
+        }
+    }
+
+    auto const session = state.tail.GetSession();
+    for (auto &series : state.series)
+    {
+        // Hidden series keep their cached points on disk until first shown
+        if (series->visible)
+        {
+            series->cache.Request(state.pool);
+        }
+        auto errMsg = std::string{};
+        if (!series->cache.Restore(series->timeSeries, series->reader, errMsg))
+        {
+            // Live points are not kept until then, the history read after
+            // restoring covers them
+            TakeLive(state, *series);
+            continue;
+        }
+        if (!errMsg.empty())
+        {
+            LogE("Failed to restore the cached %s: %s", series->title.c_str(), errMsg.c_str());
+        }
+
+        // History is read from the newest cached point on, so a cache that
+        // is up to date needs no reads at all
+        if (series->visible && state.db.IsConnected() && !series->history.IsStarted())
+        {
+            auto const now = std::chrono::duration<double>{
+                std::chrono::system_clock::now().time_since_epoch()}.count();
+            auto const &timeSeries = series->timeSeries;
+            auto start = now - std::max(state.historyDays, 0) * 24 * 60 * 60.0;
+            if (!timeSeries.IsEmpty())
+            {
+                start = std::max(start, timeSeries.TimeStamp(timeSeries.Size() - 1));
+            }
+            series->history.Start(start, now);
+        }
+        series->history.Update(state.pool, state.db, series->timeSeries, series->reader);
+
+        auto const live = TakeLive(state, *series);
+        series->merger.AddLive(series->timeSeries, series->reader, live, session,
+                               IsPolled(*series));
+    }
+
+    if (IsFutureDone(state.pollFuture))
+    {
+        auto const result = state.pollFuture.get();
+        auto const now = PollScheduler::Clock::now();
+        auto const tailConnected = state.tail.IsConnected();
+
+        // Polls that ran on a previous connection are dropped. The readers
+        // only move on for accepted results and the series stay due, so the
+        // next poll reads the same range from the new server right away.
+        if (result.generation == state.db.GetGeneration())
+        {
+            for (size_t i = 0; i < state.polled.size(); ++i)
+            {
+                auto &series = *state.series[state.polled[i]];
+                series.reader.SkipTo(result.newest[i]);
+
+                // Series the tail does not feed are never in sync with it
+                series.merger.AddDb(series.timeSeries, result.samples[i],
+                                    tailConnected && !series.tailMeasurement.empty());
+                state.scheduler.Done(series.id, !result.samples[i].IsEmpty(), now);
+            }
+        }
+    }
+
+    auto exportErrMsg = std::string{};
+    if (state.exporter.TakeResult(exportErrMsg))
+    {
+        state.exportStatus = exportErrMsg.empty() ? "Exported " + state.exportJob.path
+                                                  : "Export failed: " + exportErrMsg;
+        if (!exportErrMsg.empty())
+        {
+            LogE("Export failed: %s", exportErrMsg.c_str());
+        }
+    }
+
+    for (auto const &stat : state.db.TakeStats())
+    {
+        state.profiler.AddQuery(stat.seconds, stat.points);
+    }
+
+    for (auto &series : state.series)
+    {
+        auto errMsg = std::string{};
+        if (!series->cache.Store(series->timeSeries, errMsg))
+        {
+            LogE("Failed to cache %s: %s", series->title.c_str(), errMsg.c_str());
+        }
+    }
+
+    if (state.polling && !state.pollFuture.valid())
+    {
+        StartPoll(state);
+    }
+}
+
+// Rolling graph of a profiler value with its percentiles in the legend
+static void PlotRolling(char const *const label, Rolling const &rolling)
+{
+    // The ID after ### stays the same while the percentiles change
+    char legend[128];
+    std::snprintf(legend, sizeof(legend), "%s (p50 %.1f, p95 %.1f, p99 %.1f)###%s", label,
+                  static_cast<double>(rolling.Percentile(0.5f)),
+                  static_cast<double>(rolling.Percentile(0.95f)),
+                  static_cast<double>(rolling.Percentile(0.99f)), label);
+    auto const &values = rolling.GetValues();
+    ImPlot::PlotLine(legend, values.data(), static_cast<int>(values.size()), 1.0, 0.0,
+                     0, static_cast<int>(rolling.GetOffset()));
+}
+
+// Overlay showing where frame time goes and how the background queries do
+static void DrawProfiler(State &state)
+{
+    auto const &profiler = state.profiler;
+    ImGui::SetNextWindowSize({480, 640}, ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.85f);
+    if (ImGui::Begin("Profiler", &state.showProfiler))
+    {
+        if (ImGui::BeginTable("Sections", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("ms per frame");
+            ImGui::TableSetupColumn("Last");
+            ImGui::TableSetupColumn("p50");
+            ImGui::TableSetupColumn("p95");
+            ImGui::TableSetupColumn("p99");
+            ImGui::TableHeadersRow();
+
+            auto const row = [](char const *const name, Rolling const &rolling) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(name);
+                for (auto const value : {rolling.Last(), rolling.Percentile(0.5f),
+                                         rolling.Percentile(0.95f), rolling.Percentile(0.99f)})
+                {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", static_cast<double>(value));
+                }
+            };
+            for (size_t i = 0; i < Profiler::SECTION_COUNT; ++i)
+            {
+                auto const section = static_cast<Profiler::Section>(i);
+                row(Profiler::SectionNames[i], profiler.GetSection(section));
+            }
+            row("Total", profiler.GetFrames());
+            ImGui::EndTable();
+        }
+
+        static constexpr auto axisFlags = ImPlotAxisFlags_AutoFit;
+        if (ImPlot::BeginPlot("Frame time", {-1, 200}))
+        {
+            ImPlot::SetupAxes("Frame", "ms", axisFlags, axisFlags);
+            for (size_t i = 0; i < Profiler::SECTION_COUNT; ++i)
+            {
+                auto const section = static_cast<Profiler::Section>(i);
+                PlotRolling(Profiler::SectionNames[i], profiler.GetSection(section));
+            }
+            ImPlot::EndPlot();
+        }
+
+        if (ImPlot::BeginPlot("Queries", {-1, 200}))
+        {
+            ImPlot::SetupAxes("Query", "ms", axisFlags, axisFlags);
+            ImPlot::SetupAxis(ImAxis_Y2, "Points", axisFlags);
+            PlotRolling("Latency", profiler.GetQueryMilliseconds());
+            ImPlot::SetAxes(ImAxis_X1, ImAxis_Y2);
+            PlotRolling("Decoded points", profiler.GetQueryPoints());
+            ImPlot::EndPlot();
+        }
+
+        auto points = size_t{0};
+        auto bytes = size_t{0};
+        auto usage = std::vector<std::pair<size_t, Series const *>>{};
+        for (auto const &series : state.series)
+        {
+            auto const seriesBytes = series->timeSeries.MemoryUsage();
+            points += series->timeSeries.Size();
+            bytes += seriesBytes;
+            usage.emplace_back(seriesBytes, series.get());
+        }
+        ImGui::Text("%zu series: %zu points, %.1f MiB", state.series.size(), points,
+                    static_cast<double>(bytes) / (1024.0 * 1024.0));
+
+        // Only the series using the most memory, there may be hundreds
+        auto const shown = std::min(usage.size(), MaxProfiledSeries);
+        auto const largest = [](auto const &a, auto const &b) { return a.first > b.first; };
+        std::partial_sort(usage.begin(), usage.begin() + static_cast<std::ptrdiff_t>(shown),
+                          usage.end(), largest);
+        if (0 != shown &&
+            ImGui::BeginTable("Series", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Series");
+            ImGui::TableSetupColumn("Points");
+            ImGui::TableSetupColumn("MiB");
+            ImGui::TableHeadersRow();
+            for (size_t i = 0; i < shown; ++i)
+            {
+                auto const &[seriesBytes, series] = usage[i];
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(series->title.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%zu", series->timeSeries.Size());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", static_cast<double>(seriesBytes) / (1024.0 * 1024.0));
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
 }
 
-// Wrapper for SDL functions returning pointers to SDL data types. Will log
-// errors and crash the program in case of an error.
-template <typename T> T *SDL(T *const ptr)
+// Statistics of the points held locally inside of the time range each plot
+// on screen shows
+static void DrawStatistics(State &state)
 {
-    if (nullptr == ptr)
+    ImGui::SetNextWindowSize({720, 320}, ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.85f);
+    if (ImGui::Begin("Statistics", &state.showStatistics))
     {
-        LogE("SDL Error: %s", SDL_GetError());
-        exit(1);
+        static constexpr auto tableFlags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg;
+        if (ImGui::BeginTable("Statistics", 9, tableFlags))
+        {
+            for (auto const *const name :
+                 {"Series", "Points", "Min", "Max", "Mean", "Std dev", "p5", "p50", "p95"})
+            {
+                ImGui::TableSetupColumn(name);
+            }
+            ImGui::TableHeadersRow();
+
+            auto const start = std::chrono::steady_clock::now();
+            for (auto const &series : state.series)
+            {
+                if (!series->visible)
+                {
+                    continue;
+                }
+
+                auto const statistics =
+                    ComputeStatistics(series->timeSeries, series->xMin, series->xMax);
+                auto const &summary = statistics.summary;
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(series->title.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%zu", summary.count);
+                if (0 == summary.count)
+                {
+                    continue;
+                }
+
+                for (auto const value : {summary.min, summary.max, summary.mean, summary.StdDev()})
+                {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", value);
+                }
+                for (auto const value : statistics.percentiles)
+                {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("~%.2f", value);
+                }
+            }
+            auto const elapsed = std::chrono::duration<double, std::milli>{
+                std::chrono::steady_clock::now() - start};
+            ImGui::EndTable();
+
+            ImGui::Text("Computed in %.3f ms", elapsed.count());
+        }
     }
-    return ptr;
+    ImGui::End();
 }
 
-// Draw modal user dialog for connecting to the InfluxDB instance
-static void DrawConnectDialog(State &state)
+// Histogram of the values of a series, or a heatmap of the values of two
+// series measured together such as humidity over temperature. Binning runs
+// on the worker pool, only the bins are drawn.
+static void DrawDistribution(State &state)
 {
-    static auto errorMsg = std::string{};
-    if (state.showConnDialog)
-    {
-        ImGui::OpenPopup("Connect");
-    }
-
-    if (ImGui::BeginPopupModal("Connect"))
+    ImGui::SetNextWindowSize({520, 520}, ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Distribution", &state.showDistribution))
     {
-        ImGui::InputText("InfluxDB URL", &state.influxDbUrl);
+        auto names = std::vector<char const *>{"None"};
+        for (auto const &series : state.series)
+        {
+            names.emplace_back(series->title.c_str());
+        }
+        auto const count = static_cast<int>(names.size());
+
+        // Entries of the second combo are shifted by the leading "None"
+        auto y = state.distributionY + 1;
+        auto changed =
+            ImGui::Combo("Values", &state.distributionX, names.data() + 1, count - 1, -1);
+        changed = ImGui::Combo("Against", &y, names.data(), count, -1) || changed;
+        if (changed)
+        {
+            state.distributionY = y - 1;
+            state.distribution.Reset();
+        }
 
-        if (ImGui::Button("Connect"))
+        auto const index = [&](int const i) {
+            return 0 <= i && static_cast<size_t>(i) < state.series.size()
+                       ? state.series[static_cast<size_t>(i)].get()
+                       : nullptr;
+        };
+        auto const *const seriesX = index(state.distributionX);
+        auto const *const seriesY = index(state.distributionY);
+        if (nullptr != seriesX)
         {
-            LogI("Trying to connect to '%s'", state.influxDbUrl.c_str());
-            if (state.db.Connect(state.influxDbUrl, errorMsg))
-            {
-                errorMsg.clear();
+            auto const *const timeSeriesY = nullptr == seriesY ? nullptr : &seriesY->timeSeries;
+            state.distribution.Update(state.pool, seriesX->timeSeries, timeSeriesY);
+        }
 
-                state.temperatureFuture = std::async(
-                    std::launch::async, std::ref(state.temperatureReader), std::ref(state.db));
-                state.humidityFuture = std::async(
-                    std::launch::async, std::ref(state.humidityReader), std::ref(state.db));
+        auto const &bins = state.distribution.GetBins();
+        auto const maxCount = bins.counts.empty()
+                                  ? 0.0
+                                  : *std::max_element(bins.counts.begin(), bins.counts.end());
+        static constexpr auto axisFlags = ImPlotAxisFlags_AutoFit;
+        if (nullptr != seriesX && 1 == bins.rows && ImPlot::BeginPlot("Histogram", {-1, -1}))
+        {
+            ImPlot::SetupAxes(seriesX->yLabel.c_str(), "Points", axisFlags, axisFlags);
 
-                state.showConnDialog = false;
-                ImGui::CloseCurrentPopup();
-                LogI("Connected");
+            auto const width = (bins.xMax - bins.xMin) / static_cast<double>(bins.columns);
+            auto centers = std::vector<double>(bins.columns);
+            for (size_t i = 0; i < bins.columns; ++i)
+            {
+                centers[i] = bins.xMin + (static_cast<double>(i) + 0.5) * width;
             }
-            else
+            ImPlot::SetNextFillStyle(seriesX->color);
+            ImPlot::PlotBars(seriesX->title.c_str(), centers.data(), bins.counts.data(),
+                             static_cast<int>(bins.columns), width);
+            ImPlot::EndPlot();
+        }
+        else if (nullptr != seriesX && nullptr != seriesY && 1 < bins.rows)
+        {
+            ImPlot::ColormapScale("##Scale", 0.0, maxCount, {60, -1});
+            ImGui::SameLine();
+            if (ImPlot::BeginPlot("Heatmap", {-1, -1}))
             {
-                LogE("Failed to connect to %s: %s", state.influxDbUrl.c_str(), errorMsg.c_str());
+                ImPlot::SetupAxes(seriesX->yLabel.c_str(), seriesY->yLabel.c_str(), axisFlags,
+                                  axisFlags);
+                ImPlot::PlotHeatmap("##Bins", bins.counts.data(), static_cast<int>(bins.rows),
+                                    static_cast<int>(bins.columns), 0.0, maxCount, nullptr,
+                                    {bins.xMin, bins.yMin}, {bins.xMax, bins.yMax});
+                ImPlot::EndPlot();
             }
         }
+    }
+    ImGui::End();
+}
 
-        ImGui::SameLine();
-        if (ImGui::Button("Cancel"))
+// Scatter plot of two series paired by time and their correlation over a
+// sliding window. Joining runs on the worker pool, only the points appended
+// since the last pass are joined. Changed settings start over in the
+// background while the previous result is still drawn.
+static void DrawCorrelation(State &state)
+{
+    ImGui::SetNextWindowSize({520, 720}, ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Correlation", &state.showCorrelation))
+    {
+        auto names = std::vector<char const *>{};
+        for (auto const &series : state.series)
         {
-            state.showConnDialog = false;
-            ImGui::CloseCurrentPopup();
+            names.emplace_back(series->title.c_str());
         }
-
-        if (!errorMsg.empty())
+        auto const count = static_cast<int>(names.size());
+
+        auto &settings = state.correlationSettings;
+        auto mode = static_cast<int>(settings.mode);
+        auto tolerance = static_cast<float>(settings.tolerance);
+        auto window = static_cast<float>(settings.window / 60.0);
+        auto changed = ImGui::Combo("Values", &state.correlationA, names.data(), count, -1);
+        changed = ImGui::Combo("Against", &state.correlationB, names.data(), count, -1) || changed;
+        changed = ImGui::Combo("Pair with", &mode, "Nearest point\0Interpolated\0") || changed;
+        changed = ImGui::SliderFloat("Tolerance", &tolerance, 0.0f, 60.0f, "%.1f s") || changed;
+        changed = ImGui::SliderFloat("Window", &window, 1.0f, 24 * 60.0f, "%.0f min",
+                                     ImGuiSliderFlags_Logarithmic) ||
+                  changed;
+        if (changed)
         {
-            ImGui::TextWrapped("Failed to connect: %s", errorMsg.c_str());
+            settings.mode = static_cast<JoinMode>(mode);
+            settings.tolerance = static_cast<double>(tolerance);
+            settings.window = static_cast<double>(window) * 60.0;
+            state.correlation.Reset();
         }
 
-        ImGui::EndPopup();
+        auto const index = [&](int const i) {
+            return 0 <= i && static_cast<size_t>(i) < state.series.size()
+                       ? state.series[static_cast<size_t>(i)].get()
+                       : nullptr;
+        };
+        auto const *const seriesA = index(state.correlationA);
+        auto const *const seriesB = index(state.correlationB);
+        if (nullptr != seriesA && nullptr != seriesB)
+        {
+            auto &correlation = state.correlation;
+            correlation.Update(state.pool, seriesA->timeSeries, seriesB->timeSeries, settings);
+
+            static constexpr auto axisFlags = ImPlotAxisFlags_AutoFit;
+            auto const height = ImGui::GetContentRegionAvail().y / 2.0f;
+            if (ImPlot::BeginPlot("Scatter", {-1, height}))
+            {
+                ImPlot::SetupAxes(seriesA->yLabel.c_str(), seriesB->yLabel.c_str(), axisFlags,
+                                  axisFlags);
+                auto const getter = [](int const idx, void *const data) {
+                    auto const [x, y] =
+                        static_cast<Correlation *>(data)->ScatterAt(static_cast<size_t>(idx));
+                    return ImPlotPoint{x, y};
+                };
+                ImPlot::SetNextMarkerStyle(ImPlotMarker_Circle, 2.0f);
+                ImPlot::PlotScatterG("Pairs", getter, &correlation,
+                                     static_cast<int>(correlation.ScatterSize()));
+                ImPlot::EndPlot();
+            }
+
+            auto const &timeSeries = correlation.GetSeries();
+            if (ImPlot::BeginPlot("Rolling correlation", {-1, -1}))
+            {
+                ImPlot::SetupAxes("Timestamp", "r", axisFlags, ImPlotAxisFlags_None);
+                ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Time);
+                ImPlot::SetupAxisLimits(ImAxis_Y1, -1.0, 1.0);
+
+                auto const pixels = static_cast<size_t>(std::max(ImPlot::GetPlotSize().x, 1.0f));
+                auto const limits = ImPlot::GetPlotLimits();
+                DrawPyramid("r", timeSeries, limits.X.Min, limits.X.Max, pixels, seriesA->color);
+                ImPlot::EndPlot();
+            }
+        }
     }
+    ImGui::End();
 }
 
-// Draw the main window menu
-static void DrawMainMenuBar(State &state)
+// Export the selected series to a file. The range is either the one shown by
+// the plots of the selected series or the last hours.
+static void DrawExport(State &state)
 {
-    if (ImGui::BeginMainMenuBar())
+    auto &job = state.exportJob;
+    ImGui::SetNextWindowSize({480, 400}, ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Export", &state.showExport))
     {
-        if (ImGui::BeginMenu("File"))
-        {
-            if (ImGui::MenuItem("Connect to database"))
-            {
-                state.showConnDialog = true;
-            }
+        auto const running = state.exporter.IsRunning();
+        ImGui::BeginDisabled(running);
 
-            if (ImGui::MenuItem("Exit"))
+        if (ImGui::BeginChild("Series", {0, 160}, true))
+        {
+            for (auto &series : state.series)
             {
-                auto event = SDL_Event{SDL_QUIT};
-                SDL_PushEvent(&event);
+                ImGui::Checkbox(series->title.c_str(), &series->exported);
             }
-            ImGui::EndMenu();
         }
+        ImGui::EndChild();
 
-        if (ImGui::BeginMenu("View"))
+        if (ImGui::RadioButton("Range shown", state.exportVisibleRange))
         {
-            ImGui::Checkbox("Fit to data", &state.fitToData);
+            state.exportVisibleRange = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Last hours", !state.exportVisibleRange))
+        {
+            state.exportVisibleRange = false;
+        }
+        if (!state.exportVisibleRange)
+        {
+            ImGui::InputInt("Hours", &state.exportHours);
+        }
 
-            ImGui::EndMenu();
+        if (ImGui::RadioButton("CSV", Exporter::Format::CSV == job.format))
+        {
+            job.format = Exporter::Format::CSV;
         }
-        ImGui::EndMainMenuBar();
-    }
-}
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Binary", Exporter::Format::BINARY == job.format))
+        {
+            job.format = Exporter::Format::BINARY;
+        }
+        ImGui::InputText("File", &job.path);
 
-// Graph time series for a measurement
-static void DrawTimeSeries(std::string const &title, std::string const &yLabel,
-                           TimeSeries &timeSeries, ImVec4 const &color = IMPLOT_AUTO_COL)
-{
-    if (ImPlot::BeginPlot(title.c_str()))
-    {
-        ImPlot::SetupAxes("Timestamp", yLabel.c_str());
-        ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Time);
+        job.keys.clear();
+        job.from = std::numeric_limits<double>::infinity();
+        job.to = -std::numeric_limits<double>::infinity();
+        for (auto const &series : state.series)
+        {
+            if (!series->exported)
+            {
+                continue;
+            }
+            job.keys.emplace_back(series->title);
 
-        auto &style = ImPlot::GetStyle();
-        style.UseLocalTime = true;
-        style.Marker = ImPlotMarker_Circle;
+            // Series that were never drawn have no range of their own
+            if (series->xMin < series->xMax)
+            {
+                job.from = std::min(job.from, series->xMin);
+                job.to = std::max(job.to, series->xMax);
+            }
+        }
+        if (!state.exportVisibleRange || job.from >= job.to)
+        {
+            job.to = std::chrono::duration<double>{
+                std::chrono::system_clock::now().time_since_epoch()}.count();
+            job.from = job.to - std::max(state.exportHours, 1) * 60 * 60.0;
+        }
 
-        ImPlot::SetNextLineStyle(color);
+        auto const ready = !job.keys.empty() && !job.path.empty() && state.db.IsConnected();
+        if (ImGui::Button("Export") && ready)
+        {
+            state.exportStatus.clear();
+            state.exporter.Start(state.pool, state.db, job);
+            LogI("Exporting %zu series to %s", job.keys.size(), job.path.c_str());
+        }
+        ImGui::EndDisabled();
 
-        ImPlot::PlotLine(title.c_str(), timeSeries.timeStamps.data(), timeSeries.values.data(),
-                         static_cast<int>(timeSeries.timeStamps.size()));
+        if (running)
+        {
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel"))
+            {
+                state.exporter.Cancel();
+            }
+            ImGui::ProgressBar(state.exporter.GetProgress());
+        }
 
-        ImPlot::EndPlot();
+        if (!state.exportStatus.empty())
+        {
+            ImGui::TextWrapped("%s", state.exportStatus.c_str());
+        }
     }
+    ImGui::End();
 }
 
-// Update time data from database
-static void UpdateData(State &state)
+// Grid of plots for all series matching the filter. Only the rows on screen
+// are drawn, the other series are marked hidden.
+static void DrawDashboard(State &state)
 {
-    if (IsFutureDone(state.temperatureFuture))
+    ImGui::SetNextItemWidth(200.0f);
+    ImGui::InputText("Filter", &state.filter);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(100.0f);
+    ImGui::SliderInt("Columns", &state.columns, 1, 6);
+
+    auto shown = std::vector<Series *>{};
+    for (auto &series : state.series)
     {
-        auto const temperatures = state.temperatureFuture.get();
-        state.temperatures.Append(temperatures);
-        state.temperatureFuture =
-            std::async(std::launch::async, std::ref(state.temperatureReader), std::ref(state.db));
+        series->visible = false;
+        if (std::string::npos != series->title.find(state.filter))
+        {
+            shown.emplace_back(series.get());
+        }
     }
 
-    if (IsFutureDone(state.humidityFuture))
+    if (ImGui::BeginChild("Dashboard"))
     {
-        auto const humidities = state.humidityFuture.get();
-        state.humidities.Append(humidities);
-        state.humidityFuture =
-            std::async(std::launch::async, std::ref(state.humidityReader), std::ref(state.db));
+        auto const &spacing = ImGui::GetStyle().ItemSpacing;
+        auto const available = ImGui::GetContentRegionAvail();
+        auto const columns = static_cast<size_t>(std::max(state.columns, 1));
+        auto const rows = (shown.size() + columns - 1) / columns;
+
+        // Few plots share the window, many scroll
+        auto const fitting = (available.y - spacing.y * static_cast<float>(rows)) /
+                             static_cast<float>(std::max(rows, size_t{1}));
+        auto const size = ImVec2{
+            (available.x - spacing.x * static_cast<float>(columns - 1)) /
+                static_cast<float>(columns),
+            std::max(fitting, TileHeight)};
+
+        auto clipper = ImGuiListClipper{};
+        clipper.Begin(static_cast<int>(rows), size.y + spacing.y);
+        while (clipper.Step())
+        {
+            for (auto row = static_cast<size_t>(clipper.DisplayStart);
+                 row < static_cast<size_t>(clipper.DisplayEnd); ++row)
+            {
+                for (auto i = row * columns; i < std::min((row + 1) * columns, shown.size()); ++i)
+                {
+                    if (i != row * columns)
+                    {
+                        ImGui::SameLine();
+                    }
+                    DrawTimeSeries(state, *shown[i], size);
+                    shown[i]->visible = true;
+                }
+            }
+        }
+        clipper.End();
     }
+    ImGui::EndChild();
+
+    state.downsampleCache.Trim();
 }
 
 // Display the current input
@@ -224,26 +1379,33 @@ static void RenderFrame(State &state)
     static auto const windowFlags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoResize;
     if (ImGui::Begin(Title.c_str(), nullptr, windowFlags))
     {
+        DrawDashboard(state);
+        ImGui::End();
+    }
 
-        if (ImPlot::BeginSubplots("Sensor data", 2, 1, ImGui::GetContentRegionAvail()))
-        {
-            if (state.fitToData)
-            {
-                ImPlot::SetNextAxesToFit();
-            }
-            DrawTimeSeries("Temperature", "Temperature in °C", state.temperatures,
-                           TemperatureColor);
+    if (state.showProfiler)
+    {
+        DrawProfiler(state);
+    }
 
-            if (state.fitToData)
-            {
-                ImPlot::SetNextAxesToFit();
-            }
-            DrawTimeSeries("Humidity", "Humidity in %", state.humidities, HumidityColor);
+    if (state.showStatistics)
+    {
+        DrawStatistics(state);
+    }
 
-            ImPlot::EndSubplots();
-        }
+    if (state.showExport)
+    {
+        DrawExport(state);
+    }
 
-        ImGui::End();
+    if (state.showDistribution)
+    {
+        DrawDistribution(state);
+    }
+
+    if (state.showCorrelation)
+    {
+        DrawCorrelation(state);
     }
 }
 
@@ -291,8 +1453,160 @@ static void RenderGol(SDL_Renderer *const renderer, gol::Gol &gol, float const w
     }
 }
 
-int main(int, char **)
+// Milliseconds the main loop may wait for events before the next frame has
+// to be drawn anyway: at the latest after the max idle interval, or when the
+// next poll is due. Finished background work wakes it up earlier.
+static int IdleTimeout(State &state)
+{
+    using namespace std::chrono;
+
+    auto const now = PollScheduler::Clock::now();
+    auto timeout = duration_cast<milliseconds>(duration<float>{state.maxIdleSeconds});
+
+    // The progress of an export or connection attempt has no event of its
+    // own
+    if (state.exporter.IsRunning() || state.connectFuture.valid())
+    {
+        timeout = std::min(timeout, milliseconds{100});
+    }
+
+    if (state.polling && !state.pollFuture.valid())
+    {
+        for (auto const &series : state.series)
+        {
+            if (WantsPoll(*series))
+            {
+                auto const untilDue = ceil<milliseconds>(state.scheduler.Next(series->id) - now);
+                timeout = std::min(timeout, untilDue);
+            }
+        }
+    }
+    return static_cast<int>(std::max(timeout.count(), milliseconds::rep{0}));
+}
+
+// Logs the usage string, the GUI has no console on Windows to print it to.
+// It is an error unless asked for with --help.
+static void Usage(char const *const executable, bool const error)
+{
+    static constexpr auto Text =
+        "Usage:\n\n"
+        "%s [--help] [--benchmark POINTS] [--series N] [--frames N]\n"
+        "    [--downsampling none|lttb|minmax|pyramid] [--report FILE]\n\n"
+        "--benchmark runs without a window on N series of POINTS synthetic points,\n"
+        "plays back a pan and zoom sequence for the given number of frames and\n"
+        "logs percentiles of the frame time and of the time downsampling jobs\n"
+        "take on the workers, which --report also writes to FILE.\n";
+    if (error)
+    {
+        LogE(Text, executable);
+    }
+    else
+    {
+        LogI(Text, executable);
+    }
+}
+
+// Turns command line arguments into the benchmark settings, returns false
+// on invalid arguments. `help` is set if the usage was asked for.
+static bool ParseArguments(int const argc, char *argv[], BenchmarkConfig &config, bool &help)
+{
+    using namespace std::string_literals;
+
+    auto const number = [](char const *const arg, size_t &value) {
+        auto const s = std::string_view{arg};
+        auto const [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+        return std::errc{} == ec && s.data() + s.size() == end;
+    };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const arg = std::string{argv[i]};
+        auto const hasValue = i + 1 < argc;
+
+        if ("--help"s == arg)
+        {
+            help = true;
+        }
+        else if ("--benchmark"s == arg && hasValue)
+        {
+            if (!number(argv[++i], config.points))
+            {
+                return false;
+            }
+        }
+        else if ("--series"s == arg && hasValue)
+        {
+            if (!number(argv[++i], config.series))
+            {
+                return false;
+            }
+        }
+        else if ("--frames"s == arg && hasValue)
+        {
+            if (!number(argv[++i], config.frames))
+            {
+                return false;
+            }
+        }
+        else if ("--report"s == arg && hasValue)
+        {
+            config.report = argv[++i];
+        }
+        else if ("--downsampling"s == arg && hasValue)
+        {
+            auto const name = std::string{argv[++i]};
+            if ("none"s == name)
+            {
+                config.downsampling = Downsampling::NONE;
+            }
+            else if ("lttb"s == name)
+            {
+                config.downsampling = Downsampling::LTTB;
+            }
+            else if ("minmax"s == name)
+            {
+                config.downsampling = Downsampling::MIN_MAX;
+            }
+            else if ("pyramid"s == name)
+            {
+                config.downsampling = Downsampling::PYRAMID;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
 {
+    auto benchmark = BenchmarkConfig{};
+    auto help = false;
+    if (!ParseArguments(argc, argv, benchmark, help))
+    {
+        Usage(argv[0], true);
+        return 1;
+    }
+    if (help)
+    {
+        Usage(argv[0], false);
+        return 0;
+    }
+    auto const benchmarking = 0 != benchmark.points;
+
+    // The benchmark renders in software to an offscreen window, so it runs
+    // the same on any machine, also without a display
+    if (benchmarking)
+    {
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+    }
+
     SDL(SDL_Init(SDL_INIT_VIDEO));
     defer(SDL_Quit());
 
@@ -306,7 +1620,9 @@ int main(int, char **)
                                        SDL_WINDOWPOS_UNDEFINED, Width, Height, windowFlags));
     defer(SDL_DestroyWindow(window));
 
-    static constexpr Uint32 renderFlags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC;
+    auto const renderFlags = benchmarking
+                                 ? Uint32{SDL_RENDERER_SOFTWARE}
+                                 : Uint32{SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC};
     static constexpr int deviceIndex = -1;
     auto renderer = SDL(SDL_CreateRenderer(window, deviceIndex, renderFlags));
     defer(SDL_DestroyRenderer(renderer));
@@ -329,14 +1645,85 @@ int main(int, char **)
     defer(ImGui_ImplSDLRenderer2_Shutdown());
 
     auto state = State{};
+    if (benchmarking)
+    {
+        state.showConnDialog = false;
+        state.fitToData = false;
+        state.columns = 1;
+        state.downsampling = benchmark.downsampling;
+        state.retention = {};
+
+        auto const now = std::chrono::duration<double>{
+            std::chrono::system_clock::now().time_since_epoch()}.count();
+        for (size_t i = 0; i < benchmark.series; ++i)
+        {
+            AddSeries(state, "benchmark,series=" + std::to_string(i));
+            FillSynthetic(state.series.back()->timeSeries, benchmark.points, now,
+                          static_cast<unsigned>(i));
+        }
+        LogI("Generated %zu series of %zu points", benchmark.series, benchmark.points);
+    }
+
+    // Cached history is loaded in the background while the first frames are
+    // drawn already
+    if (auto *const prefPath = SDL_GetPrefPath("iot-projekt2", "gui"); nullptr != prefPath)
+    {
+        state.cacheDirectory = prefPath;
+        SDL_free(prefPath);
+    }
+
+    // The series ingress writes, more are found in the database on connect.
+    // Their caches are opened once it is known which database they are of.
+    if (!benchmarking)
+    {
+        AddSeries(state, "temperature");
+        AddSeries(state, "humidity");
+    }
 
+    // Background work and the live tail wake up the main loop when they
+    // have new data
+    auto const wakeUpEvent = SDL_RegisterEvents(1);
+    auto const wakeUp = [wakeUpEvent]() {
+        auto event = SDL_Event{};
+        event.type = wakeUpEvent;
+        SDL_PushEvent(&event);
+    };
+    state.pool.SetOnTaskDone(wakeUp);
+    state.tail.SetOnReceive(wakeUp);
+
+    // ImGui needs a few frames after input until hover states and layout
+    // have settled
+    static constexpr int framesAfterEvent = 3;
+    auto framesToDraw = framesAfterEvent;
+
+    auto frameTimes = std::vector<float>{};
+    auto downsampleTimes = std::vector<float>{};
     auto shouldQuit = false;
     while (!shouldQuit)
     {
+        if (benchmarking && !state.series.empty())
+        {
+            auto const &timeSeries = state.series.front()->timeSeries;
+            state.scriptedView =
+                ScriptedView(frameTimes.size(), benchmark.frames, timeSeries.TimeStamp(0),
+                             timeSeries.TimeStamp(timeSeries.Size() - 1));
+        }
+
         auto event = SDL_Event{};
         static constexpr int noMoreEvents = 0;
-        while (noMoreEvents != SDL_PollEvent(&event))
+
+        // Block while idle, the game of life is animated all the time
+        auto const animated = Application::EASTER_EGG == state.app || benchmarking;
+        auto hasEvent = 0 == framesToDraw && !animated
+                            ? noMoreEvents != SDL_WaitEventTimeout(&event, IdleTimeout(state))
+                            : noMoreEvents != SDL_PollEvent(&event);
+
+        auto &profiler = state.profiler;
+        profiler.Begin(Profiler::EVENTS);
+        for (; hasEvent; hasEvent = noMoreEvents != SDL_PollEvent(&event))
         {
+            framesToDraw = framesAfterEvent;
+
             ImGui_ImplSDL2_ProcessEvent(&event);
             if (event.type == SDL_QUIT)
             {
@@ -379,13 +1766,20 @@ int main(int, char **)
         ImGui_ImplSDLRenderer2_NewFrame();
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
+        profiler.End(Profiler::EVENTS);
 
         if (Application::VISUALISIERUNG == state.app)
         {
+            profiler.Begin(Profiler::UPDATE_DATA);
             UpdateData(state);
+            profiler.End(Profiler::UPDATE_DATA);
+
+            profiler.Begin(Profiler::RENDER_FRAME);
             RenderFrame(state);
+            profiler.End(Profiler::RENDER_FRAME);
         }
 
+        profiler.Begin(Profiler::IMGUI_RENDER);
         ImGui::Render();
         SDL(SDL_RenderSetScale(renderer, io.DisplayFramebufferScale.x,
                                io.DisplayFramebufferScale.y));
@@ -411,8 +1805,38 @@ int main(int, char **)
             RenderGol(renderer, state.gol, static_cast<float>(width), static_cast<float>(height));
         }
 
+        profiler.End(Profiler::IMGUI_RENDER);
+
+        profiler.Begin(Profiler::PRESENT);
         SDL_RenderPresent(renderer);
+        profiler.End(Profiler::PRESENT);
+        profiler.EndFrame();
+
+        framesToDraw = std::max(framesToDraw - 1, 0);
+
+        if (benchmarking)
+        {
+            frameTimes.emplace_back(profiler.GetFrames().Last());
+            auto const latencies = state.downsampleCache.TakeLatencies();
+            downsampleTimes.insert(downsampleTimes.end(), latencies.begin(), latencies.end());
+            shouldQuit = shouldQuit || frameTimes.size() >= benchmark.frames;
+        }
     }
 
+    if (benchmarking)
+    {
+        auto const report = FormatBenchmark(benchmark, frameTimes, downsampleTimes);
+        LogI("%s", report.c_str());
+        if (!benchmark.report.empty())
+        {
+            auto file = std::ofstream{benchmark.report};
+            file << report;
+            if (!file)
+            {
+                LogE("Failed to write the benchmark report to %s", benchmark.report.c_str());
+                return 1;
+            }
+        }
+    }
     return 0;
 }
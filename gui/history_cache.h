@@ -0,0 +1,374 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+#include "async.h"
+#include "binary_io.h"
+#include "db_reader.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "time_series.h"
+
+// Local copy of the history of one measurement, so the GUI starts with the
+// data it had when it was closed and only reads what is new since then from
+// the database.
+//
+// Points are stored in two column files that are only ever appended to:
+// <file>.time with int64 milliseconds since epoch and <file>.value with
+// float values, the same resolution TimeSeries keeps, see FileName.
+// Compacting replaces both at once, see Rewrite. Loading reads them through
+// a memory mapping, but copies the points within the retention, as the
+// series keeps its points in chunks of its own. Every database gets a
+// directory of its own, named after a hash of its URL.
+class HistoryCache
+{
+  public:
+    HistoryCache(std::string const &name) : name(name)
+    {
+    }
+
+    // Locate the cached points of the database at `dbUrl`, they are only
+    // loaded once requested. Points outside of the retention are skipped. An
+    // empty directory disables the cache. Call once connected, so the points
+    // are those of the server actually read from.
+    void Open(std::string const &directory, std::string const &dbUrl,
+              Retention const &retention)
+    {
+        opened = true;
+        if (directory.empty())
+        {
+            restored = true;
+            return;
+        }
+
+        auto const databaseDirectory = std::filesystem::path{directory} / Hash(dbUrl);
+        auto ec = std::error_code{};
+        std::filesystem::create_directories(databaseDirectory, ec);
+
+        auto const base = databaseDirectory / FileName(name);
+        timePath = base.string() + ".time";
+        valuePath = base.string() + ".value";
+        this->retention = retention;
+    }
+
+    // Start loading the cached points on the worker pool, e.g. once the
+    // series is shown for the first time. Does nothing before Open and after
+    // the first call.
+    void Request(ThreadPool &pool)
+    {
+        if (opened && !restored && !future.valid())
+        {
+            future = pool.Submit(Load, timePath, valuePath, retention);
+        }
+    }
+
+    // Once loading finished, hands the cached points newer than the ones
+    // in `ts` to it and lets `reader` continue after the newest of them.
+    // Returns false until opened, requested and loaded. Nothing is restored
+    // if loading failed, see `errMsg`.
+    bool Restore(TimeSeries &ts, DbReader &reader, std::string &errMsg)
+    {
+        if (restored || !IsFutureDone(future))
+        {
+            return restored;
+        }
+        restored = true;
+
+        auto loaded = future.get();
+        if (!loaded.errMsg.empty())
+        {
+            errMsg = loaded.errMsg;
+            return true;
+        }
+
+        if (!loaded.samples.IsEmpty())
+        {
+            ts.AppendNewer(loaded.samples);
+            newest = Milliseconds(loaded.samples.TimeStamp(loaded.samples.Size() - 1));
+            reader.SkipTo(newest * 1000000);
+        }
+
+        times.open(timePath, std::ios::binary | std::ios::app);
+        values.open(valuePath, std::ios::binary | std::ios::app);
+        if (!times || !values)
+        {
+            errMsg = "Failed to open " + timePath + " for writing";
+        }
+        return true;
+    }
+
+    bool IsRestored() const
+    {
+        return restored;
+    }
+
+    // Append the points of `ts` that are newer than the newest cached one
+    bool Store(TimeSeries const &ts, std::string &errMsg)
+    {
+        if (!times.is_open() || !values.is_open() || ts.IsEmpty())
+        {
+            return true;
+        }
+
+        auto first = ts.Size();
+        while (first > 0 && Milliseconds(ts.TimeStamp(first - 1)) > newest)
+        {
+            --first;
+        }
+        if (ts.Size() == first)
+        {
+            return true;
+        }
+
+        for (auto i = first; i < ts.Size(); ++i)
+        {
+            Write(times, Milliseconds(ts.TimeStamp(i)));
+            Write(values, static_cast<float>(ts.Value(i)));
+        }
+        times.flush();
+        values.flush();
+        newest = Milliseconds(ts.TimeStamp(ts.Size() - 1));
+
+        if (!times || !values)
+        {
+            errMsg = "Failed to write to " + timePath;
+            times.close();
+            values.close();
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    struct Loaded
+    {
+        Samples samples;
+        std::string errMsg;
+    };
+
+    // 64 bit FNV-1a as hex, stable across runs unlike std::hash
+    static std::string Hash(std::string const &s)
+    {
+        auto hash = std::uint64_t{14695981039346656037u};
+        for (auto const c : s)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211u;
+        }
+
+        static constexpr char Hex[] = "0123456789abcdef";
+        auto hex = std::string(16, '0');
+        for (auto i = hex.size(); i-- > 0; hash >>= 4)
+        {
+            hex[i] = Hex[hash & 0xF];
+        }
+        return hex;
+    }
+
+    // Series keys contain characters that are not safe in file names. The
+    // safe ones give a readable prefix, e.g. temperature_device_a for
+    // temperature,device=a, and the hash of the whole key keeps keys apart
+    // that only differ in the others or in case.
+    static std::string FileName(std::string const &key)
+    {
+        static constexpr size_t MaxPrefix = 64;
+
+        auto prefix = key.substr(0, MaxPrefix);
+        for (auto &c : prefix)
+        {
+            auto const safe = ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+                              ('0' <= c && c <= '9') || '-' == c || '_' == c;
+            c = safe ? c : '_';
+        }
+        return prefix + "-" + Hash(key);
+    }
+
+    template <typename T> static T Read(MappedFile const &file, size_t const i)
+    {
+        auto value = T{};
+        std::memcpy(&value, static_cast<char const *>(file.Data()) + i * sizeof(T), sizeof(T));
+        return value;
+    }
+
+    // Loading may recover or rewrite the columns. A reconnect opens a new
+    // cache for the same files while the previous one may still be loading,
+    // so loads of the same files take turns.
+    static std::mutex &FileMutex(std::string const &timePath)
+    {
+        static auto registryMutex = std::mutex{};
+        static auto mutexes = std::unordered_map<std::string, std::unique_ptr<std::mutex>>{};
+
+        auto const lg = std::lock_guard{registryMutex};
+        auto &mutex = mutexes[timePath];
+        if (nullptr == mutex)
+        {
+            mutex = std::make_unique<std::mutex>();
+        }
+        return *mutex;
+    }
+
+    static Loaded Load(std::string const timePath, std::string const valuePath,
+                       Retention const retention)
+    {
+        auto const lg = std::lock_guard{FileMutex(timePath)};
+
+        auto loaded = Loaded{};
+        if (!Recover(timePath, valuePath))
+        {
+            loaded.errMsg = "Failed to finish compacting " + timePath;
+            return loaded;
+        }
+
+        auto ec = std::error_code{};
+        if (!std::filesystem::exists(timePath, ec) || !std::filesystem::exists(valuePath, ec))
+        {
+            return loaded;
+        }
+
+        // Columns of different length are left behind by a crash while
+        // writing. Most expired points are dropped from the files as well.
+        auto rewrite = false;
+        {
+            auto times = MappedFile{};
+            auto values = MappedFile{};
+            if (!times.Open(timePath, loaded.errMsg) || !values.Open(valuePath, loaded.errMsg))
+            {
+                return loaded;
+            }
+
+            auto const count = std::min(times.Size() / sizeof(std::int64_t),
+                                        values.Size() / sizeof(float));
+            auto first = size_t{0};
+            if (0 != count && retention.maxAge > 0.0)
+            {
+                auto const oldest = Read<std::int64_t>(times, count - 1) -
+                                    std::llround(retention.maxAge * 1000.0);
+
+                // Points are cached in chronological order
+                auto last = count;
+                while (first < last)
+                {
+                    auto const middle = first + (last - first) / 2;
+                    if (Read<std::int64_t>(times, middle) < oldest)
+                    {
+                        first = middle + 1;
+                    }
+                    else
+                    {
+                        last = middle;
+                    }
+                }
+            }
+            if (0 != retention.maxPoints && count - first > retention.maxPoints)
+            {
+                first = count - retention.maxPoints;
+            }
+
+            loaded.samples.timeStamps.reserve(count - first);
+            loaded.samples.values.reserve(count - first);
+            for (auto i = first; i < count; ++i)
+            {
+                loaded.samples.Push(static_cast<double>(Read<std::int64_t>(times, i)) / 1000.0,
+                                    static_cast<double>(Read<float>(values, i)));
+            }
+
+            rewrite = times.Size() != count * sizeof(std::int64_t) ||
+                      values.Size() != count * sizeof(float) || 2 * first > count;
+        }
+
+        if (rewrite && !Rewrite(timePath, valuePath, loaded.samples))
+        {
+            loaded.errMsg = "Failed to compact " + timePath;
+        }
+        return loaded;
+    }
+
+    // Replace both columns with `samples`. They are written to temporary
+    // files first, once both are complete a marker file commits them and
+    // only then they are renamed over the columns. A crash in between never
+    // pairs a new column with an old one, see Recover.
+    static bool Rewrite(std::string const &timePath, std::string const &valuePath,
+                        Samples const &samples)
+    {
+        {
+            auto times = std::ofstream{timePath + ".tmp", std::ios::binary | std::ios::trunc};
+            auto values = std::ofstream{valuePath + ".tmp", std::ios::binary | std::ios::trunc};
+            for (size_t i = 0; i < samples.Size(); ++i)
+            {
+                Write(times, Milliseconds(samples.TimeStamp(i)));
+                Write(values, static_cast<float>(samples.Value(i)));
+            }
+            times.close();
+            values.close();
+            if (!times || !values)
+            {
+                return false;
+            }
+        }
+
+        if (!std::ofstream{CommitPath(timePath)})
+        {
+            return false;
+        }
+        return Recover(timePath, valuePath);
+    }
+
+    // Finish a rewrite that was committed but not completely renamed yet and
+    // drop the temporary files of one that was not committed
+    static bool Recover(std::string const &timePath, std::string const &valuePath)
+    {
+        auto ec = std::error_code{};
+        auto const commit = CommitPath(timePath);
+        if (!std::filesystem::exists(commit, ec))
+        {
+            std::filesystem::remove(timePath + ".tmp", ec);
+            std::filesystem::remove(valuePath + ".tmp", ec);
+            return true;
+        }
+
+        for (auto const &path : {timePath, valuePath})
+        {
+            if (std::filesystem::exists(path + ".tmp", ec))
+            {
+                std::filesystem::rename(path + ".tmp", path, ec);
+                if (ec)
+                {
+                    return false;
+                }
+            }
+        }
+        return std::filesystem::remove(commit, ec);
+    }
+
+    static std::string CommitPath(std::string const &timePath)
+    {
+        return timePath + ".commit";
+    }
+
+    std::string name;
+    std::string timePath;
+    std::string valuePath;
+    Retention retention;
+
+    std::future<Loaded> future;
+    bool opened = false;
+    bool restored = false;
+
+    std::ofstream times;
+    std::ofstream values;
+
+    // Milliseconds since epoch of the newest cached point
+    std::int64_t newest = std::numeric_limits<std::int64_t>::min();
+};
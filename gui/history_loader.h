@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "async.h"
+#include "db.h"
+#include "db_reader.h"
+#include "query_decoder.h"
+#include "series_key.h"
+#include "thread_pool.h"
+#include "time_series.h"
+
+// Loads the history of a measurement in pages of PageSpan seconds. A few
+// pages are read concurrently, as many as Db::TryReserve allows for all
+// loaders together. Finished pages are appended to the time series in order
+// as soon as all pages before them are, so the plot fills up from the left
+// while the rest is still loading. Pages are only ever appended once read,
+// failed ones are read again until they are.
+class HistoryLoader
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr double PageSpan = 6 * 60 * 60.0;
+
+    // Failed pages are read again after this many seconds, doubled for every
+    // further failure up to MaxRetryDelay
+    static constexpr double RetryDelay = 1.0;
+    static constexpr double MaxRetryDelay = 30.0;
+
+    HistoryLoader(std::string const &name) : selector(SeriesKey{name}.Selector())
+    {
+    }
+
+    // Split the range (start, end] in seconds into pages
+    void Start(double const start, double const end)
+    {
+        started = true;
+        this->end = end;
+        for (auto from = start; from < end; from += PageSpan)
+        {
+            pages.emplace_back().from = from;
+            pages.back().to = std::min(from + PageSpan, end);
+        }
+    }
+
+    bool IsStarted() const
+    {
+        return started;
+    }
+
+    bool IsLoaded() const
+    {
+        return loaded;
+    }
+
+    // Issues page reads and appends the finished pages that are next in
+    // line to `ts`. Once everything is loaded `reader` continues at the end
+    // of the range, never before.
+    void Update(ThreadPool &pool, Db &db, TimeSeries &ts, DbReader &reader)
+    {
+        if (!started || loaded)
+        {
+            return;
+        }
+
+        auto const now = Clock::now();
+        for (auto &page : pages)
+        {
+            // Pages read under a previous connection or failing while
+            // disconnected are read again once connected, without backing off
+            if (IsFutureDone(page.future))
+            {
+                auto result = page.future.get();
+                auto const current = page.generation == db.GetGeneration();
+                if (current && result.ok)
+                {
+                    page.done = true;
+                    page.samples = std::move(result.samples);
+                }
+                else if (current && db.IsConnected())
+                {
+                    page.failures = std::min(page.failures + 1, 16);
+                    auto const delay = std::min(
+                        RetryDelay * static_cast<double>(1 << (page.failures - 1)), MaxRetryDelay);
+                    page.retry = now + std::chrono::duration_cast<Clock::duration>(
+                                           std::chrono::duration<double>{delay});
+                }
+            }
+
+            if (!page.done && !page.future.valid() && now >= page.retry && db.IsConnected() &&
+                db.TryReserve())
+            {
+                page.generation = db.GetGeneration();
+                page.future = pool.Submit(Read, std::ref(db), selector, page.from, page.to);
+            }
+        }
+
+        while (!pages.empty() && pages.front().done)
+        {
+            ts.AppendNewer(pages.front().samples);
+            pages.pop_front();
+        }
+
+        loaded = pages.empty();
+        if (loaded)
+        {
+            reader.Resume(static_cast<std::int64_t>(end * 1e9));
+        }
+    }
+
+    // Calls `f` with the pages that arrived before the ones preceding them,
+    // so they can be drawn until they are appended
+    template <typename F> void ForEachWaiting(F const &f) const
+    {
+        for (auto const &page : pages)
+        {
+            if (page.done && !page.samples.IsEmpty())
+            {
+                f(page.samples);
+            }
+        }
+    }
+
+  private:
+    struct Result
+    {
+        Samples samples;
+        bool ok = false;
+    };
+
+    struct Page
+    {
+        double from = 0.0;
+        double to = 0.0;
+        size_t generation = 0;
+        bool done = false;
+
+        // Reads in a row that failed, and when to try again
+        int failures = 0;
+        Clock::time_point retry;
+
+        Samples samples;
+        std::future<Result> future;
+    };
+
+    static Result Read(Db &db, std::string const selector, double const from, double const to)
+    {
+        auto stream = std::stringstream{};
+        stream << "select value " << selector                     //
+               << "time > " << static_cast<std::int64_t>(from * 1e9) //
+               << " and time <= " << static_cast<std::int64_t>(to * 1e9);
+        auto const query = stream.str();
+
+        auto result = Result{};
+        auto errMsg = std::string{};
+        auto series = std::vector<QuerySeries>{};
+        result.ok = db.Query(query, series, errMsg);
+        db.Release();
+        for (auto const &s : series)
+        {
+            for (size_t i = 0; i < s.timeStamps.size(); ++i)
+            {
+                result.samples.Push(DbReader::NanosecondsToSeconds(s.timeStamps[i]), s.values[i]);
+            }
+        }
+        return result;
+    }
+
+    std::string selector;
+    bool started = false;
+    bool loaded = false;
+    double end = 0.0;
+
+    // Pages not appended yet, oldest first
+    std::deque<Page> pages;
+};
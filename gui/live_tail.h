@@ -0,0 +1,368 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "constants.h"
+#include "db_reader.h"
+#include "series_key.h"
+#include "time_series.h"
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <date/date.h>
+
+#include <mqtt/async_client.h>
+
+// Subscribes to the sensor topic directly, so new points reach the GUI as
+// soon as they are published instead of after a round trip through ingress
+// and InfluxDB. Messages arrive on the MQTT client's thread and are collected
+// per watched measurement until the render thread takes them.
+//
+// Payloads carry no tags, so only untagged series can be fed by the tail,
+// see IsTailFed.
+class LiveTail
+{
+  public:
+    LiveTail() = default;
+    LiveTail(LiveTail const &) = delete;
+    LiveTail &operator=(LiveTail const &) = delete;
+
+    // Waits at most DisconnectTimeout for the broker to confirm, shutting
+    // down does not hang on an unresponsive one. Either way the client is
+    // destroyed before the members its callbacks use, see `client`.
+    ~LiveTail()
+    {
+        auto const lg = std::lock_guard{clientMutex};
+        if (nullptr != client && client->is_connected())
+        {
+            try
+            {
+                client->disconnect()->wait_for(DisconnectTimeout);
+            }
+            catch (mqtt::exception const &)
+            {
+                // Shutting down either way
+            }
+        }
+    }
+
+    // Whether the points of the series `key` come in through the tail, the
+    // ones of tagged series are only ever read from the database
+    static bool IsTailFed(std::string const &key)
+    {
+        return !SeriesKey{key}.HasTags();
+    }
+
+    // Called on the MQTT client's thread whenever there is something new to
+    // take. Set before connecting.
+    void SetOnReceive(std::function<void()> f)
+    {
+        onReceive = std::move(f);
+    }
+
+    // How often a connection attempt checks whether it was cancelled
+    static constexpr auto CancelInterval = std::chrono::milliseconds{50};
+
+    // How long closing the GUI waits for the broker to confirm disconnecting
+    static constexpr auto DisconnectTimeout = std::chrono::seconds{1};
+
+    // Blocks for at most `timeout` or until `cancel` is set, safe to call
+    // from a worker while the render thread checks IsConnected
+    bool Connect(std::string const &url, std::chrono::milliseconds const timeout,
+                 std::atomic<bool> const &cancel, std::string &errMsg) noexcept
+    {
+        try
+        {
+            // Every GUI needs its own client id, otherwise the broker drops
+            // the older connection
+            auto const clientId = "gui-" + std::to_string(std::random_device{}());
+            auto newClient = std::make_unique<mqtt::async_client>(
+                url, clientId, mqtt::create_options{MqttVersion});
+
+            auto *const c = newClient.get();
+            c->set_connected_handler([this, c](std::string const &) {
+                // Nothing is persisted across sessions, so subscribe again
+                // after every reconnect and let consumers know about the gap
+                ++session;
+                c->subscribe(MqttTopic, MqttQos);
+                if (onReceive)
+                {
+                    onReceive();
+                }
+            });
+            c->set_message_callback(
+                [this](mqtt::const_message_ptr const message) { Receive(message->get_payload()); });
+
+            auto const connOpts =
+                mqtt::connect_options_builder()
+                    .mqtt_version(MqttVersion)
+                    .automatic_reconnect(std::chrono::seconds{2}, std::chrono::seconds{30})
+                    .clean_start(true)
+                    .connect_timeout(timeout)
+                    .finalize();
+            auto const token = c->connect(connOpts);
+            auto const deadline = std::chrono::steady_clock::now() + timeout;
+            while (!token->wait_for(CancelInterval))
+            {
+                if (cancel)
+                {
+                    errMsg = "Cancelled";
+                    return false;
+                }
+                if (std::chrono::steady_clock::now() >= deadline)
+                {
+                    errMsg = "Timed out";
+                    return false;
+                }
+            }
+
+            auto previous = std::unique_ptr<mqtt::async_client>{};
+            {
+                auto const lg = std::lock_guard{clientMutex};
+                previous = std::exchange(client, std::move(newClient));
+            }
+
+            // The previous client is disconnected outside of the lock, so
+            // IsConnected does not wait for it
+            if (nullptr != previous && previous->is_connected())
+            {
+                try
+                {
+                    previous->disconnect()->wait_for(timeout);
+                }
+                catch (mqtt::exception const &)
+                {
+                    // It is released either way
+                }
+            }
+            return true;
+        }
+        catch (mqtt::exception const &e)
+        {
+            errMsg = e.what();
+            return false;
+        }
+    }
+
+    bool IsConnected() const noexcept
+    {
+        auto const lg = std::lock_guard{clientMutex};
+        return nullptr != client && client->is_connected();
+    }
+
+    // Counts the subscriptions made so far. Points published while the
+    // count did not change were all received.
+    size_t GetSession() const noexcept
+    {
+        return session;
+    }
+
+    // Start collecting the points of a measurement, points of measurements
+    // nobody watches are dropped. Whoever watches has to take them
+    // regularly.
+    void Watch(std::string const &measurement)
+    {
+        auto const lg = std::lock_guard{m};
+        watched.insert(measurement);
+    }
+
+    // Moves out the points of a measurement received since the last call
+    Samples Take(std::string const &measurement)
+    {
+        auto const lg = std::lock_guard{m};
+        auto samples = Samples{};
+        if (auto const it = received.find(measurement); received.end() != it)
+        {
+            samples = std::move(it->second);
+            received.erase(it);
+        }
+        return samples;
+    }
+
+  private:
+    // Every numeric field of a payload besides the timestamp is stored as
+    // the measurement of the same name, the same way ingress writes them
+    void Receive(std::string const &payload)
+    {
+        try
+        {
+            auto ptree = boost::property_tree::ptree{};
+            auto stream = std::stringstream{payload};
+            boost::property_tree::read_json(stream, ptree);
+
+            // A payload without a valid timestamp is dropped as a whole,
+            // its points would end up at the epoch otherwise
+            auto timestamp = std::chrono::system_clock::time_point{};
+            auto parsed = std::istringstream{ptree.get<std::string>("timestamp")};
+            parsed >> date::parse(TimeStampFormat, timestamp);
+            if (parsed.fail())
+            {
+                return;
+            }
+            auto const seconds =
+                std::chrono::duration<double>{timestamp.time_since_epoch()}.count();
+
+            {
+                auto const lg = std::lock_guard{m};
+                for (auto const &[name, field] : ptree)
+                {
+                    if ("timestamp" != name && 0 != watched.count(name))
+                    {
+                        received[name].Push(seconds, field.get_value<double>());
+                    }
+                }
+            }
+
+            if (onReceive)
+            {
+                onReceive();
+            }
+        }
+        catch (boost::property_tree::ptree_error const &)
+        {
+            // Malformed payloads are dropped, ingress logs them already
+        }
+    }
+
+    std::function<void()> onReceive;
+    std::atomic<size_t> session = 0;
+
+    std::mutex m;
+    std::set<std::string> watched;
+    std::map<std::string, Samples> received;
+
+    // Only guards swapping the client. Declared last, so the client is
+    // destroyed before the state its callbacks use.
+    mutable std::mutex clientMutex;
+    std::unique_ptr<mqtt::async_client> client;
+};
+
+// Merges the live tail and database reads of one measurement into its
+// TimeSeries, in timestamp order and without duplicates.
+//
+// While the tail is in sync new points come from it alone and the database
+// is not polled. After the tail (re)subscribes there may be a gap, so live
+// points are held back until a database read has caught up with them.
+class TailMerger
+{
+  public:
+    // Database reads give up on catching up with the tail after this many
+    // attempts, in case ingress is down
+    static constexpr size_t MaxAttempts = 5;
+
+    // Whether the database has to be polled for points the tail missed
+    bool NeedsPoll() const
+    {
+        return !synced;
+    }
+
+    // `polled` tells whether the database is polled for the series, see
+    // NeedsPoll. Points of series that are not, e.g. hidden ones or those
+    // still loading their history, are not held back. The database read that
+    // starts once they are polled covers them.
+    void AddLive(TimeSeries &ts, DbReader &reader, Samples const &live, size_t const session,
+                 bool const polled)
+    {
+        if (session != currentSession)
+        {
+            currentSession = session;
+            synced = false;
+            attempts = 0;
+        }
+
+        if (!polled && !synced)
+        {
+            pending = Samples{};
+            return;
+        }
+        if (live.IsEmpty())
+        {
+            return;
+        }
+
+        if (synced)
+        {
+            ts.AppendNewer(live);
+
+            // Later backfills only need to start where the tail left off
+            if (!ts.IsEmpty())
+            {
+                reader.SkipTo(Milliseconds(ts.TimeStamp(ts.Size() - 1)) * 1000000);
+            }
+            return;
+        }
+
+        pending = Merge(pending, live);
+    }
+
+    void AddDb(TimeSeries &ts, Samples const &read, bool const tailConnected)
+    {
+        auto newest = ts.IsEmpty() ? std::numeric_limits<std::int64_t>::min()
+                                   : Milliseconds(ts.TimeStamp(ts.Size() - 1));
+        if (!read.IsEmpty())
+        {
+            newest = std::max(newest, Milliseconds(read.TimeStamp(read.Size() - 1)));
+        }
+
+        auto const caughtUp =
+            !pending.IsEmpty() &&
+            (Milliseconds(pending.TimeStamp(0)) <= newest || ++attempts >= MaxAttempts);
+
+        if (!tailConnected || caughtUp)
+        {
+            ts.AppendNewer(Merge(read, pending));
+            pending = Samples{};
+            synced = tailConnected;
+            attempts = 0;
+            return;
+        }
+
+        // Everything read is older than the live points held back
+        ts.AppendNewer(read);
+    }
+
+  private:
+    static Samples Merge(Samples const &a, Samples const &b)
+    {
+        auto merged = Samples{};
+        auto i = size_t{0};
+        auto j = size_t{0};
+        while (i < a.Size() || j < b.Size())
+        {
+            auto const takeA =
+                j >= b.Size() ||
+                (i < a.Size() && Milliseconds(a.TimeStamp(i)) <= Milliseconds(b.TimeStamp(j)));
+            auto const &from = takeA ? a : b;
+            auto &index = takeA ? i : j;
+
+            auto const timeStamp = Milliseconds(from.TimeStamp(index));
+            if (merged.IsEmpty() || Milliseconds(merged.TimeStamp(merged.Size() - 1)) < timeStamp)
+            {
+                merged.Push(from.TimeStamp(index), from.Value(index));
+            }
+            ++index;
+        }
+        return merged;
+    }
+
+    bool synced = false;
+    size_t currentSession = 0;
+    size_t attempts = 0;
+
+    // Live points waiting for the database to fill the gap before them
+    Samples pending;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. Pages are only read from disk
+// when they are touched.
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    bool Open(std::string const &path, std::string &errMsg) noexcept
+    {
+        Close();
+
+#ifdef _WIN32
+        auto const file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (INVALID_HANDLE_VALUE == file)
+        {
+            errMsg = "Failed to open " + path;
+            return false;
+        }
+
+        auto fileSize = LARGE_INTEGER{};
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            errMsg = "Failed to get the size of " + path;
+            CloseHandle(file);
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+
+        // Empty files can not be mapped, but are valid
+        if (0 != size)
+        {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data = nullptr == mapping ? nullptr : MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        CloseHandle(file);
+#else
+        auto const file = open(path.c_str(), O_RDONLY);
+        if (0 > file)
+        {
+            errMsg = "Failed to open " + path;
+            return false;
+        }
+
+        struct stat status = {};
+        if (0 != fstat(file, &status))
+        {
+            errMsg = "Failed to get the size of " + path;
+            close(file);
+            return false;
+        }
+        size = static_cast<size_t>(status.st_size);
+
+        // Empty files can not be mapped, but are valid
+        if (0 != size)
+        {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+            data = MAP_FAILED == data ? nullptr : data;
+        }
+        close(file);
+#endif
+
+        if (0 != size && nullptr == data)
+        {
+            errMsg = "Failed to map " + path;
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void const *Data() const
+    {
+        return data;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+  private:
+    void Close()
+    {
+#ifdef _WIN32
+        if (nullptr != data)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (nullptr != mapping)
+        {
+            CloseHandle(mapping);
+        }
+        mapping = nullptr;
+#else
+        if (nullptr != data)
+        {
+            munmap(data, size);
+        }
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+    void *data = nullptr;
+    size_t size = 0;
+};
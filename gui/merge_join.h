@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cmath>
+
+#include "time_series.h"
+
+// How a point of one series is paired with the other series, which measured
+// at slightly different times
+enum class JoinMode
+{
+    // The nearest point of the other series if it is at most the tolerance
+    // away
+    NEAREST,
+
+    // The other series interpolated linearly between the points around,
+    // unless they are more than the tolerance apart
+    INTERPOLATE,
+};
+
+// Where a join continues once more points were appended, as absolute indices
+// (see TimeSeries::GetEvicted()), so it survives points being evicted
+struct JoinCursor
+{
+    size_t a = 0;
+    size_t b = 0;
+};
+
+// Calls `f(timeStamp, valueA, valueB)` for every point of `a` from index `i`
+// on that can be paired with `b` from index `j` on, in a single pass over
+// both series as they are sorted by time. Works on anything with Size(),
+// TimeStamp(i) and Value(i) such as TimeSeries and Samples. Leaves `i` at
+// the first point of `a` that cannot be paired yet because `b` has no point
+// at or after it and `j` where `b` continues, so repeated calls only visit
+// the points appended since.
+template <typename A, typename B, typename F>
+static void MergeJoin(A const &a, B const &b, JoinMode const mode, double const tolerance,
+                      size_t &i, size_t &j, F const &f)
+{
+    for (; i < a.Size() && j < b.Size(); ++i)
+    {
+        auto const t = a.TimeStamp(i);
+
+        // Last point of b at or before t, if there is one
+        while (j + 1 < b.Size() && b.TimeStamp(j + 1) <= t)
+        {
+            ++j;
+        }
+
+        auto const t0 = b.TimeStamp(j);
+        if (t0 > t)
+        {
+            // Before the start of b, there is nothing to interpolate from
+            if (JoinMode::NEAREST == mode && t0 - t <= tolerance)
+            {
+                f(t, a.Value(i), b.Value(j));
+            }
+            continue;
+        }
+        if (t0 == t)
+        {
+            f(t, a.Value(i), b.Value(j));
+            continue;
+        }
+        if (j + 1 == b.Size())
+        {
+            // Wait for the next point of b
+            break;
+        }
+
+        auto const t1 = b.TimeStamp(j + 1);
+        if (JoinMode::NEAREST == mode)
+        {
+            auto const k = t - t0 <= t1 - t ? j : j + 1;
+            if (std::abs(b.TimeStamp(k) - t) <= tolerance)
+            {
+                f(t, a.Value(i), b.Value(k));
+            }
+        }
+        else if (t1 - t0 <= tolerance)
+        {
+            auto const v0 = b.Value(j);
+            auto const v1 = b.Value(j + 1);
+            f(t, a.Value(i), v0 + (v1 - v0) * (t - t0) / (t1 - t0));
+        }
+    }
+}
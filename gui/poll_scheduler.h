@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "random.h"
+
+// Decides when each series is polled next. Every series has its own
+// interval, which is stretched by random jitter so polls of different GUIs
+// do not line up, and backs off exponentially while polls return no data.
+class PollScheduler
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config
+    {
+        // Seconds between polls while data is arriving
+        float interval = 1.0f;
+
+        // Fraction of the interval polls are randomly moved by
+        float jitter = 0.1f;
+
+        // Upper bound for the interval while backing off
+        float maxInterval = 30.0f;
+    };
+
+    // Register a series and return its id. It is due right away.
+    size_t Add(Config const &config)
+    {
+        entries.push_back({config, 0, Clock::now()});
+        return entries.size() - 1;
+    }
+
+    size_t Size() const
+    {
+        return entries.size();
+    }
+
+    Config &GetConfig(size_t const id)
+    {
+        return entries.at(id).config;
+    }
+
+    Clock::time_point Next(size_t const id) const
+    {
+        return entries.at(id).next;
+    }
+
+    // Ids of all series whose next poll is due
+    std::vector<size_t> Due(Clock::time_point const now) const
+    {
+        auto due = std::vector<size_t>{};
+        for (size_t id = 0; id < entries.size(); ++id)
+        {
+            if (entries[id].next <= now)
+            {
+                due.emplace_back(id);
+            }
+        }
+        return due;
+    }
+
+    // Schedule the next poll of a series after one finished
+    void Done(size_t const id, bool const gotData, Clock::time_point const now)
+    {
+        auto &entry = entries.at(id);
+        entry.misses = gotData ? 0 : std::min(entry.misses + 1, 16);
+
+        auto const backoff = static_cast<float>(1 << entry.misses);
+        auto const interval = std::min(entry.config.interval * backoff,
+                                       std::max(entry.config.maxInterval, entry.config.interval));
+        auto const jitter = GetRandomNumber(-entry.config.jitter, entry.config.jitter);
+
+        entry.next = now + std::chrono::duration_cast<Clock::duration>(
+                               std::chrono::duration<float>{interval * (1.0f + jitter)});
+    }
+
+  private:
+    struct Entry
+    {
+        Config config;
+        int misses;
+        Clock::time_point next;
+    };
+
+    std::vector<Entry> entries;
+};
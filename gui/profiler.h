@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Fixed number of the most recent values, oldest first starting at `offset`
+// like ImPlot expects for scrolling plots
+class Rolling
+{
+  public:
+    static constexpr size_t Capacity = 600;
+
+    void Push(float const value)
+    {
+        if (values.size() < Capacity)
+        {
+            values.emplace_back(value);
+            return;
+        }
+        values[offset] = value;
+        offset = (offset + 1) % Capacity;
+    }
+
+    std::vector<float> const &GetValues() const
+    {
+        return values;
+    }
+
+    size_t GetOffset() const
+    {
+        return offset;
+    }
+
+    float Last() const
+    {
+        return values.empty() ? 0.0f : values[(offset + values.size() - 1) % values.size()];
+    }
+
+    // Nearest rank percentile, `p` in [0, 1]
+    float Percentile(float const p) const
+    {
+        if (values.empty())
+        {
+            return 0.0f;
+        }
+
+        auto sorted = values;
+        auto const rank =
+            static_cast<size_t>(p * static_cast<float>(sorted.size() - 1) + 0.5f);
+        auto const nth = sorted.begin() + static_cast<std::ptrdiff_t>(rank);
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        return *nth;
+    }
+
+  private:
+    std::vector<float> values;
+    size_t offset = 0;
+};
+
+// Records where the time of every frame goes, split into the sections of the
+// main loop, plus the latency and size of the queries running in the
+// background.
+class Profiler
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    enum Section
+    {
+        EVENTS,
+        UPDATE_DATA,
+        RENDER_FRAME,
+        IMGUI_RENDER,
+        PRESENT,
+        SECTION_COUNT,
+    };
+
+    static constexpr std::array<char const *, SECTION_COUNT> SectionNames{
+        "Events", "UpdateData", "RenderFrame", "ImGui render", "Present"};
+
+    void Begin(Section const section)
+    {
+        starts[section] = Clock::now();
+    }
+
+    void End(Section const section)
+    {
+        current[section] +=
+            std::chrono::duration<float, std::milli>{Clock::now() - starts[section]}.count();
+    }
+
+    // Store the sections measured since the last call as one frame
+    void EndFrame()
+    {
+        auto total = 0.0f;
+        for (size_t i = 0; i < SECTION_COUNT; ++i)
+        {
+            sections[i].Push(current[i]);
+            total += current[i];
+            current[i] = 0.0f;
+        }
+        frames.Push(total);
+    }
+
+    void AddQuery(float const seconds, size_t const points)
+    {
+        queryMilliseconds.Push(seconds * 1000.0f);
+        queryPoints.Push(static_cast<float>(points));
+    }
+
+    // Milliseconds spent in a section per frame
+    Rolling const &GetSection(Section const section) const
+    {
+        return sections[section];
+    }
+
+    // Milliseconds of CPU time per frame, not counting time spent waiting
+    // for events
+    Rolling const &GetFrames() const
+    {
+        return frames;
+    }
+
+    Rolling const &GetQueryMilliseconds() const
+    {
+        return queryMilliseconds;
+    }
+
+    Rolling const &GetQueryPoints() const
+    {
+        return queryPoints;
+    }
+
+  private:
+    std::array<Clock::time_point, SECTION_COUNT> starts;
+    std::array<float, SECTION_COUNT> current{};
+    std::array<Rolling, SECTION_COUNT> sections;
+    Rolling frames;
+
+    Rolling queryMilliseconds;
+    Rolling queryPoints;
+};
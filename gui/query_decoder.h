@@ -0,0 +1,671 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// Typed columns of one series in an InfluxDB query response
+struct QuerySeries
+{
+    std::string name;
+
+    // Index of the statement of a multi-statement query this belongs to
+    size_t statement = 0;
+
+    std::vector<std::int64_t> timeStamps; // Nanoseconds since epoch
+    std::vector<double> values;
+
+    // Columns of queries aggregating with min(value), max(value), mean(value)
+    std::vector<double> mins;
+    std::vector<double> maxs;
+    std::vector<double> means;
+
+    // Column of SHOW SERIES, which has no time column
+    std::vector<std::string> keys;
+};
+
+// Decodes the JSON that InfluxDB answers queries with straight into typed
+// columns. Only the "time" column, the value and aggregate columns and the
+// "key" column of QuerySeries are read, numbers are parsed with
+// std::from_chars so no intermediate strings or locales are involved.
+class QueryDecoder
+{
+  public:
+    // Decode a complete response. Series are appended to `series`, errors
+    // reported by the database end up in `errMsg`.
+    static bool Decode(std::string_view const json, std::vector<QuerySeries> &series,
+                       std::string &errMsg)
+    {
+        auto decoder = QueryDecoder{json};
+        if (!decoder.Response(series, errMsg))
+        {
+            if (errMsg.empty())
+            {
+                errMsg = "Malformed query response at offset " + std::to_string(decoder.pos);
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // Parse an RFC3339 timestamp as used by InfluxDB, e.g.
+    // 2023-05-01T12:34:56.123456789Z, into nanoseconds since epoch
+    static bool ParseTimeStamp(std::string_view const s, std::int64_t &ns)
+    {
+        auto const number = [&](size_t const from, size_t const length, int &out) {
+            auto const *const begin = s.data() + from;
+            auto const [end, ec] = std::from_chars(begin, begin + length, out);
+            return std::errc{} == ec && begin + length == end;
+        };
+
+        auto year = 0;
+        auto month = 0;
+        auto day = 0;
+        auto hour = 0;
+        auto minute = 0;
+        auto second = 0;
+        if (s.size() < 20 || '-' != s[4] || '-' != s[7] || 'T' != s[10] || ':' != s[13] ||
+            ':' != s[16] || !number(0, 4, year) || !number(5, 2, month) || !number(8, 2, day) ||
+            !number(11, 2, hour) || !number(14, 2, minute) || !number(17, 2, second))
+        {
+            return false;
+        }
+
+        auto pos = size_t{19};
+        auto fraction = std::int64_t{0};
+        if ('.' == s[pos])
+        {
+            auto scale = std::int64_t{100000000};
+            for (++pos; pos < s.size() && '0' <= s[pos] && s[pos] <= '9'; ++pos)
+            {
+                fraction += (s[pos] - '0') * scale;
+                scale /= 10;
+            }
+        }
+
+        auto offset = std::int64_t{0};
+        if (pos < s.size() && ('+' == s[pos] || '-' == s[pos]) && pos + 6 == s.size())
+        {
+            auto offsetHours = 0;
+            auto offsetMinutes = 0;
+            if (!number(pos + 1, 2, offsetHours) || !number(pos + 4, 2, offsetMinutes))
+            {
+                return false;
+            }
+            offset = (offsetHours * 60 + offsetMinutes) * std::int64_t{60};
+            offset = '+' == s[pos] ? offset : -offset;
+        }
+        else if (pos + 1 != s.size() || 'Z' != s[pos])
+        {
+            return false;
+        }
+
+        auto const seconds = DaysFromCivil(year, month, day) * 86400 + hour * 3600 +
+                             minute * 60 + second - offset;
+        ns = seconds * 1000000000 + fraction;
+        return true;
+    }
+
+  private:
+    QueryDecoder(std::string_view const json) : json(json)
+    {
+    }
+
+    // Days since 1970-01-01 in the proleptic Gregorian calendar, see
+    // http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+    static std::int64_t DaysFromCivil(int y, int const m, int const d)
+    {
+        y -= m <= 2;
+        auto const era = (y >= 0 ? y : y - 399) / 400;
+        auto const yoe = y - era * 400;
+        auto const doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        auto const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return std::int64_t{era} * 146097 + doe - 719468;
+    }
+
+    // {"results":[...],"error":"..."}
+    bool Response(std::vector<QuerySeries> &series, std::string &errMsg)
+    {
+        return Object([&](std::string_view const key) {
+            if ("results" == key)
+            {
+                return Array([&]() { return Result(series, errMsg); });
+            }
+            if ("error" == key)
+            {
+                return Error(errMsg);
+            }
+            return SkipValue();
+        }) && errMsg.empty();
+    }
+
+    // {"statement_id":0,"series":[...],"error":"..."}
+    bool Result(std::vector<QuerySeries> &series, std::string &errMsg)
+    {
+        auto const first = series.size();
+        auto statement = size_t{0};
+        auto const ok = Object([&](std::string_view const key) {
+            if ("statement_id" == key)
+            {
+                return Number(statement);
+            }
+            if ("series" == key)
+            {
+                return Array([&]() { return Series(series.emplace_back()); });
+            }
+            if ("error" == key)
+            {
+                return Error(errMsg);
+            }
+            return SkipValue();
+        });
+
+        // The statement id may come before or after the series
+        for (auto i = first; i < series.size(); ++i)
+        {
+            series[i].statement = statement;
+        }
+        return ok;
+    }
+
+    // Columns of QuerySeries that are read, in the order of Columns
+    static constexpr size_t ColumnCount = 4;
+    static constexpr std::array<std::string_view, ColumnCount> Columns{"value", "min", "max",
+                                                                       "mean"};
+    static constexpr size_t NoColumn = ColumnCount;
+
+    static std::array<std::vector<double> *, ColumnCount> Targets(QuerySeries &series)
+    {
+        return {&series.values, &series.mins, &series.maxs, &series.means};
+    }
+
+    // {"name":"temperature","columns":["time","value"],"values":[[...],...]}
+    bool Series(QuerySeries &series)
+    {
+        // Which of Columns every column of the response is, time and key
+        // are marked separately
+        auto columns = std::vector<size_t>{};
+        auto timeColumn = size_t{0};
+        auto keyColumn = NoColumn;
+        auto hasTime = false;
+        auto hasColumns = false;
+
+        return Object([&](std::string_view const key) {
+            if ("name" == key)
+            {
+                return Text(series.name);
+            }
+
+            if ("columns" == key)
+            {
+                auto const ok = Array([&]() {
+                    auto name = std::string_view{};
+                    if (!String(name))
+                    {
+                        return false;
+                    }
+                    if ("time" == name)
+                    {
+                        timeColumn = columns.size();
+                        hasTime = true;
+                    }
+                    if ("key" == name)
+                    {
+                        keyColumn = columns.size();
+                    }
+
+                    auto column = size_t{0};
+                    while (column < ColumnCount && Columns[column] != name)
+                    {
+                        ++column;
+                    }
+                    hasColumns = hasColumns || NoColumn != column;
+                    columns.emplace_back(column);
+                    return true;
+                });
+                hasColumns = (hasColumns && hasTime) || NoColumn != keyColumn;
+                return ok && hasColumns;
+            }
+
+            if ("values" == key)
+            {
+                if (NoColumn != keyColumn)
+                {
+                    return Array([&]() { return KeyRow(series, keyColumn); });
+                }
+                return hasColumns &&
+                       Array([&]() { return Row(series, columns, timeColumn); });
+            }
+
+            return SkipValue();
+        });
+    }
+
+    // ["2023-05-01T12:34:56Z",21.5]
+    bool Row(QuerySeries &series, std::vector<size_t> const &columns, size_t const timeColumn)
+    {
+        auto column = size_t{0};
+        auto timeStamp = std::int64_t{0};
+        auto hasTimeStamp = false;
+        auto row = std::array<double, ColumnCount>{};
+        auto hasNull = false;
+
+        auto const ok = Array([&]() {
+            auto const current = column++;
+            if (timeColumn == current)
+            {
+                auto text = std::string_view{};
+                if (Peek('"'))
+                {
+                    hasTimeStamp = String(text) && ParseTimeStamp(text, timeStamp);
+                    return hasTimeStamp;
+                }
+                hasTimeStamp = Number(timeStamp);
+                return hasTimeStamp;
+            }
+
+            if (current < columns.size() && NoColumn != columns[current])
+            {
+                if (Peek('n'))
+                {
+                    hasNull = true;
+                    return SkipValue();
+                }
+                return Number(row[columns[current]]);
+            }
+
+            return SkipValue();
+        });
+
+        // Points without a value (null) are skipped
+        if (ok && hasTimeStamp && !hasNull)
+        {
+            series.timeStamps.emplace_back(timeStamp);
+
+            auto const targets = Targets(series);
+            for (auto const c : columns)
+            {
+                if (NoColumn != c)
+                {
+                    targets[c]->emplace_back(row[c]);
+                }
+            }
+        }
+        return ok && hasTimeStamp;
+    }
+
+    // ["temperature,device=a"]
+    bool KeyRow(QuerySeries &series, size_t const keyColumn)
+    {
+        auto column = size_t{0};
+        return Array([&]() {
+            if (keyColumn != column++)
+            {
+                return SkipValue();
+            }
+            return Text(series.keys.emplace_back());
+        });
+    }
+
+    bool Error(std::string &errMsg)
+    {
+        // A malformed message is reported as a malformed response
+        if (!Text(errMsg))
+        {
+            errMsg.clear();
+            return false;
+        }
+        if (errMsg.empty())
+        {
+            errMsg = "Unknown error";
+        }
+        return true;
+    }
+
+    template <typename F> bool Object(F const &member)
+    {
+        if (!Consume('{'))
+        {
+            return false;
+        }
+        if (Consume('}'))
+        {
+            return true;
+        }
+
+        do
+        {
+            auto key = std::string_view{};
+            if (!String(key) || !Consume(':') || !member(key))
+            {
+                return false;
+            }
+        } while (Consume(','));
+
+        return Consume('}');
+    }
+
+    template <typename F> bool Array(F const &element)
+    {
+        if (!Consume('['))
+        {
+            return false;
+        }
+        if (Consume(']'))
+        {
+            return true;
+        }
+
+        do
+        {
+            if (!element())
+            {
+                return false;
+            }
+        } while (Consume(','));
+
+        return Consume(']');
+    }
+
+    // Strings are returned as they appear in the JSON, escape sequences are
+    // skipped over but not resolved. Member and column names and timestamps
+    // never contain any, see Text for everything else.
+    bool String(std::string_view &s)
+    {
+        if (!Consume('"'))
+        {
+            return false;
+        }
+
+        auto const begin = pos;
+        while (pos < json.size() && '"' != json[pos])
+        {
+            pos += '\\' == json[pos] ? 2 : 1;
+        }
+        if (pos >= json.size())
+        {
+            return false;
+        }
+
+        s = json.substr(begin, pos - begin);
+        ++pos;
+        return true;
+    }
+
+    // A string with its escape sequences resolved, such as series keys,
+    // which escape their own special characters with backslashes
+    bool Text(std::string &s)
+    {
+        auto raw = std::string_view{};
+        if (!String(raw))
+        {
+            return false;
+        }
+
+        s.clear();
+        s.reserve(raw.size());
+        for (size_t i = 0; i < raw.size(); ++i)
+        {
+            if ('\\' != raw[i])
+            {
+                s += raw[i];
+                continue;
+            }
+
+            // String made sure a character follows every backslash
+            switch (raw[++i])
+            {
+            case 'b':
+                s += '\b';
+                break;
+            case 'f':
+                s += '\f';
+                break;
+            case 'n':
+                s += '\n';
+                break;
+            case 'r':
+                s += '\r';
+                break;
+            case 't':
+                s += '\t';
+                break;
+            case 'u': {
+                auto code = std::uint32_t{0};
+                if (!Hex(raw, i + 1, code))
+                {
+                    return false;
+                }
+                i += 4;
+
+                // Characters beyond the basic plane come as surrogate pairs
+                auto low = std::uint32_t{0};
+                if (0xD800 <= code && code < 0xDC00 && "\\u" == raw.substr(i + 1, 2) &&
+                    Hex(raw, i + 3, low) && 0xDC00 <= low && low < 0xE000)
+                {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+                AppendUtf8(s, code);
+                break;
+            }
+            default:
+                // \", \\ and \/
+                s += raw[i];
+                break;
+            }
+        }
+        return true;
+    }
+
+    // The four hex digits at `at` of a \u escape sequence
+    static bool Hex(std::string_view const s, size_t const at, std::uint32_t &value)
+    {
+        if (at + 4 > s.size())
+        {
+            return false;
+        }
+        auto const *const begin = s.data() + at;
+        auto const [end, ec] = std::from_chars(begin, begin + 4, value, 16);
+        return std::errc{} == ec && begin + 4 == end;
+    }
+
+    static void AppendUtf8(std::string &s, std::uint32_t const code)
+    {
+        auto const byte = [&](std::uint32_t const b) { s += static_cast<char>(b); };
+        if (code < 0x80)
+        {
+            byte(code);
+        }
+        else if (code < 0x800)
+        {
+            byte(0xC0 | (code >> 6));
+            byte(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            byte(0xE0 | (code >> 12));
+            byte(0x80 | ((code >> 6) & 0x3F));
+            byte(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            byte(0xF0 | (code >> 18));
+            byte(0x80 | ((code >> 12) & 0x3F));
+            byte(0x80 | ((code >> 6) & 0x3F));
+            byte(0x80 | (code & 0x3F));
+        }
+    }
+
+    template <typename T> bool Number(T &value)
+    {
+        SkipWhitespace();
+        auto const *const begin = json.data() + pos;
+        auto const [end, ec] = std::from_chars(begin, json.data() + json.size(), value);
+        if (std::errc{} != ec)
+        {
+            return false;
+        }
+        pos += static_cast<size_t>(end - begin);
+        return true;
+    }
+
+    bool SkipValue()
+    {
+        SkipWhitespace();
+        if (pos >= json.size())
+        {
+            return false;
+        }
+
+        switch (json[pos])
+        {
+        case '{':
+            return Object([&](std::string_view) { return SkipValue(); });
+        case '[':
+            return Array([&]() { return SkipValue(); });
+        case '"': {
+            auto s = std::string_view{};
+            return String(s);
+        }
+        default:
+            break;
+        }
+
+        // Numbers and literals
+        auto const begin = pos;
+        while (pos < json.size() && std::string_view{",]} \t\r\n"}.find(json[pos]) ==
+                                        std::string_view::npos)
+        {
+            ++pos;
+        }
+        return pos > begin;
+    }
+
+    void SkipWhitespace()
+    {
+        while (pos < json.size() &&
+               (' ' == json[pos] || '\t' == json[pos] || '\r' == json[pos] || '\n' == json[pos]))
+        {
+            ++pos;
+        }
+    }
+
+    bool Peek(char const c)
+    {
+        SkipWhitespace();
+        return pos < json.size() && c == json[pos];
+    }
+
+    bool Consume(char const c)
+    {
+        if (Peek(c))
+        {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    std::string_view json;
+    size_t pos = 0;
+};
+
+// Decodes a response requested with chunked=true while it arrives. InfluxDB
+// sends one complete JSON document per line, each line is decoded as soon as
+// it is complete. Chunks continuing the last series are appended to its
+// columns.
+class ChunkedDecoder
+{
+  public:
+    ChunkedDecoder(std::vector<QuerySeries> &series) : series(series)
+    {
+    }
+
+    // Decode the lines completed by `data`
+    bool Feed(std::string_view const data, std::string &errMsg)
+    {
+        auto begin = size_t{0};
+        for (auto end = data.find('\n'); std::string_view::npos != end;
+             end = data.find('\n', begin))
+        {
+            auto ok = true;
+            if (pending.empty())
+            {
+                ok = Line(data.substr(begin, end - begin), errMsg);
+            }
+            else
+            {
+                pending.append(data.substr(begin, end - begin));
+                ok = Line(pending, errMsg);
+                pending.clear();
+            }
+
+            if (!ok)
+            {
+                return false;
+            }
+            begin = end + 1;
+        }
+
+        pending.append(data.substr(begin));
+        return true;
+    }
+
+    // Decode what is left after the last line break
+    bool Finish(std::string &errMsg)
+    {
+        auto const ok = Line(pending, errMsg);
+        pending.clear();
+        return ok;
+    }
+
+  private:
+    bool Line(std::string_view const line, std::string &errMsg)
+    {
+        if (std::string_view::npos == line.find_first_not_of(" \t\r"))
+        {
+            return true;
+        }
+
+        auto const first = series.size();
+        if (!QueryDecoder::Decode(line, series, errMsg))
+        {
+            return false;
+        }
+
+        if (0 < first && first < series.size())
+        {
+            auto &last = series[first - 1];
+            auto &next = series[first];
+            if (last.statement == next.statement && last.name == next.name)
+            {
+                Append(last.timeStamps, next.timeStamps);
+                Append(last.values, next.values);
+                Append(last.mins, next.mins);
+                Append(last.maxs, next.maxs);
+                Append(last.means, next.means);
+                Append(last.keys, next.keys);
+                series.erase(series.begin() + static_cast<std::ptrdiff_t>(first));
+            }
+        }
+        return true;
+    }
+
+    template <typename T> static void Append(std::vector<T> &to, std::vector<T> &from)
+    {
+        to.insert(to.end(), std::make_move_iterator(from.begin()),
+                  std::make_move_iterator(from.end()));
+    }
+
+    std::vector<QuerySeries> &series;
+
+    // Start of a line that is not complete yet
+    std::string pending;
+};
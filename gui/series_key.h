@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Key of an InfluxDB series as listed by SHOW SERIES: the measurement
+// followed by its tags, e.g. temperature,device=kitchen. Series without tags
+// are just the measurement.
+class SeriesKey
+{
+  public:
+    SeriesKey(std::string_view const key)
+    {
+        auto parts = std::vector<std::string>{{}};
+        for (size_t i = 0; i < key.size(); ++i)
+        {
+            // Commas, spaces and equal signs are escaped with a backslash
+            if ('\\' == key[i] && i + 1 < key.size())
+            {
+                parts.back() += key[++i];
+            }
+            else if (',' == key[i])
+            {
+                parts.emplace_back();
+            }
+            else if ('=' == key[i])
+            {
+                parts.back() += '\0';
+            }
+            else
+            {
+                parts.back() += key[i];
+            }
+        }
+
+        measurement = parts.front();
+        for (size_t i = 1; i < parts.size(); ++i)
+        {
+            auto const separator = parts[i].find('\0');
+            if (std::string::npos != separator)
+            {
+                tags.emplace_back(parts[i].substr(0, separator), parts[i].substr(separator + 1));
+            }
+        }
+    }
+
+    std::string const &GetMeasurement() const
+    {
+        return measurement;
+    }
+
+    bool HasTags() const
+    {
+        return !tags.empty();
+    }
+
+    // Value of a tag, empty if the series does not have it
+    std::string GetTag(std::string const &name) const
+    {
+        for (auto const &[key, value] : tags)
+        {
+            if (name == key)
+            {
+                return value;
+            }
+        }
+        return {};
+    }
+
+    // InfluxQL selecting the series, to be followed by a condition on time:
+    // from "temperature" where "device"='kitchen' and
+    std::string Selector() const
+    {
+        auto selector = "from " + Quote(measurement, '"') + " where ";
+        for (auto const &[key, value] : tags)
+        {
+            selector += Quote(key, '"') + "=" + Quote(value, '\'') + " and ";
+        }
+        return selector;
+    }
+
+  private:
+    static std::string Quote(std::string const &s, char const quote)
+    {
+        auto quoted = std::string{quote};
+        for (auto const c : s)
+        {
+            if (quote == c || '\\' == c)
+            {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + quote;
+    }
+
+    std::string measurement;
+    std::vector<std::pair<std::string, std::string>> tags;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+#include "time_series.h"
+
+// Statistics of the points of a time series inside of a time range, as shown
+// in the statistics panel
+struct Statistics
+{
+    static constexpr std::array<double, 3> Ranks{0.05, 0.5, 0.95};
+
+    Summary summary;
+
+    // Approximate percentiles at Ranks
+    std::array<double, Ranks.size()> percentiles{};
+};
+
+// Count, extremes, mean and standard deviation come from the pyramid and are
+// exact up to rounding. Percentiles come from the digests of the pyramid
+// blocks, see TimeSeries::Sketch, and are within the error bound of TDigest.
+static Statistics ComputeStatistics(TimeSeries const &ts, double const xMin, double const xMax)
+{
+    auto statistics = Statistics{};
+    auto [first, last] = VisibleRange(ts, xMin, xMax);
+
+    // Only points inside of the range count, not the neighbours lines are
+    // drawn to
+    if (first < last && ts.TimeStamp(first) < xMin)
+    {
+        ++first;
+    }
+    if (first < last && ts.TimeStamp(last - 1) > xMax)
+    {
+        --last;
+    }
+    if (first == last)
+    {
+        return statistics;
+    }
+
+    statistics.summary = ts.Summarize(first, last);
+
+    auto const digest = ts.Sketch(first, last);
+    for (size_t r = 0; r < Statistics::Ranks.size(); ++r)
+    {
+        statistics.percentiles[r] = std::clamp(digest.Quantile(Statistics::Ranks[r]),
+                                               statistics.summary.min, statistics.summary.max);
+    }
+    return statistics;
+}
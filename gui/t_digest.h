@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Mergeable sketch of a set of values for approximate percentiles, after
+// Dunning's merging t-digest. Values are clustered into at most Capacity
+// centroids, single values at the tails and larger clusters towards the
+// median, so the rank error of a percentile stays below about 1 / Capacity
+// of the count at the median and shrinks towards the tails. Merging two
+// digests gives one of the union within the same bound, so digests of blocks
+// combine into the digest of a range like a Summary does.
+class TDigest
+{
+  public:
+    static constexpr size_t Capacity = 64;
+
+    // Number of values added
+    double Count() const
+    {
+        auto count = 0.0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            count += centroids[i].weight;
+        }
+        return count;
+    }
+
+    // Add values in any order. Adding them in batches is cheaper than one by
+    // one, every call merges all centroids anew.
+    void Add(std::vector<float> values)
+    {
+        std::sort(values.begin(), values.end());
+        auto incoming = std::vector<Centroid>{};
+        incoming.reserve(values.size());
+        for (auto const value : values)
+        {
+            incoming.push_back({value, 1});
+        }
+        Compress(incoming);
+    }
+
+    void Merge(TDigest const &other)
+    {
+        auto const begin = other.centroids.begin();
+        Compress({begin, begin + static_cast<std::ptrdiff_t>(other.size)});
+    }
+
+    // Value below which the fraction q of the values lies, interpolated
+    // between the centres of the centroids. NaN if empty.
+    double Quantile(double const q) const
+    {
+        if (0 == size)
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
+        auto const target = q * Count();
+        auto cumulative = 0.0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            auto const center = cumulative + centroids[i].weight / 2.0;
+            if (target <= center)
+            {
+                if (0 == i)
+                {
+                    return static_cast<double>(centroids[i].mean);
+                }
+                auto const &previous = centroids[i - 1];
+                auto const previousCenter = cumulative - previous.weight / 2.0;
+                auto const t = (target - previousCenter) / (center - previousCenter);
+                return static_cast<double>(previous.mean) +
+                       t * static_cast<double>(centroids[i].mean - previous.mean);
+            }
+            cumulative += centroids[i].weight;
+        }
+        return static_cast<double>(centroids[size - 1].mean);
+    }
+
+  private:
+    struct Centroid
+    {
+        float mean;
+        std::uint32_t weight;
+    };
+
+    // Two neighbouring centroids span at least one step of the scale
+    // function, which has Compression / 2 steps, so this many centroids fit
+    static constexpr double Compression = static_cast<double>(Capacity - 1);
+
+    // Merge the centroids `incoming`, ordered by their means, with the ones
+    // held. Walking all of them in order, a centroid takes in its neighbours
+    // as long as it stays within one step of the scale function from where
+    // it started.
+    void Compress(std::vector<Centroid> const &incoming)
+    {
+        auto all = std::vector<Centroid>(incoming.size() + size);
+        std::merge(incoming.begin(), incoming.end(), centroids.begin(),
+                   centroids.begin() + static_cast<std::ptrdiff_t>(size), all.begin(),
+                   [](auto const &a, auto const &b) { return a.mean < b.mean; });
+        if (all.empty())
+        {
+            return;
+        }
+
+        auto total = 0.0;
+        for (auto const &c : all)
+        {
+            total += c.weight;
+        }
+
+        // The centroid being filled is kept as the sum and count of its
+        // values until it is complete
+        size = 0;
+        auto done = 0.0;
+        auto limit = total * Limit(0.0);
+        auto sum = 0.0;
+        auto weight = 0.0;
+        for (auto const &c : all)
+        {
+            // The last centroid takes in everything left should rounding
+            // ever let more steps fit
+            if (0.0 == weight || done + weight + c.weight <= limit || Capacity == size + 1)
+            {
+                sum += static_cast<double>(c.mean) * c.weight;
+                weight += c.weight;
+                continue;
+            }
+
+            centroids[size++] = {static_cast<float>(sum / weight),
+                                 static_cast<std::uint32_t>(weight)};
+            done += weight;
+            limit = total * Limit(done / total);
+            sum = static_cast<double>(c.mean) * c.weight;
+            weight = c.weight;
+        }
+        centroids[size++] = {static_cast<float>(sum / weight), static_cast<std::uint32_t>(weight)};
+    }
+
+    // Quantile a centroid starting at quantile q may grow up to, one step of
+    // the scale function k(q) = Compression / (2 pi) * asin(2q - 1) further
+    static double Limit(double const q)
+    {
+        static double const Pi = std::acos(-1.0);
+        auto const k = Compression / (2.0 * Pi) * std::asin(2.0 * std::clamp(q, 0.0, 1.0) - 1.0);
+        auto const next = std::min(k + 1.0, Compression / 4.0);
+        return (std::sin(next * 2.0 * Pi / Compression) + 1.0) / 2.0;
+    }
+
+    std::array<Centroid, Capacity> centroids{};
+    size_t size = 0;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Assertion for the tests, which do without a test framework. Unlike assert
+// it is also checked in release builds, and a failure ends the test with the
+// condition and where it is.
+#define CHECK(condition)                                                                  \
+    do                                                                                    \
+    {                                                                                     \
+        if (!(condition))                                                                 \
+        {                                                                                 \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,          \
+                         #condition);                                                     \
+            std::exit(EXIT_FAILURE);                                                      \
+        }                                                                                 \
+    } while (false)
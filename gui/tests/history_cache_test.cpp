@@ -0,0 +1,141 @@
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "check.h"
+#include "history_cache.h"
+
+static auto const Directory =
+    (std::filesystem::temp_directory_path() / "history_cache_test").string();
+
+// Open the cache of `key` like a fresh start of the GUI and restore it into
+// a new series
+static TimeSeries Restore(ThreadPool &pool, HistoryCache &cache, std::string const &key)
+{
+    auto ts = TimeSeries{};
+    auto reader = DbReader{key};
+    auto errMsg = std::string{};
+    cache.Open(Directory, "http://localhost:8086?db=test", Retention{});
+    cache.Request(pool);
+    while (!cache.Restore(ts, reader, errMsg))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    CHECK(errMsg.empty());
+    return ts;
+}
+
+// Restore the cache of `key` and store `count` more points, one per second
+static size_t RestoreAndStore(ThreadPool &pool, std::string const &key, size_t const count)
+{
+    auto cache = HistoryCache{key};
+    auto ts = Restore(pool, cache, key);
+    auto const restored = ts.Size();
+
+    auto samples = Samples{};
+    for (size_t i = 0; i < count; ++i)
+    {
+        samples.Push(1e9 + static_cast<double>(restored + i), static_cast<double>(restored + i));
+    }
+    ts.Append(samples);
+
+    auto errMsg = std::string{};
+    CHECK(cache.Store(ts, errMsg));
+    return restored;
+}
+
+// Path of the time column of `key` without its extension
+static std::string Column(std::string const &key)
+{
+    for (auto const &database : std::filesystem::directory_iterator{Directory})
+    {
+        for (auto const &file : std::filesystem::directory_iterator{database})
+        {
+            auto const name = file.path().filename().string();
+            if (0 == name.rfind(key + "-", 0) && file.path().extension() == ".time")
+            {
+                return (database.path() / file.path().stem()).string();
+            }
+        }
+    }
+    return {};
+}
+
+static void WriteTimes(std::string const &path, std::int64_t const count)
+{
+    auto file = std::ofstream{path, std::ios::binary | std::ios::trunc};
+    for (auto i = std::int64_t{0}; i < count; ++i)
+    {
+        auto const milliseconds = (1000000000 + i) * 1000;
+        file.write(reinterpret_cast<char const *>(&milliseconds), sizeof(milliseconds));
+    }
+}
+
+static void RestoresStoredPoints(ThreadPool &pool)
+{
+    CHECK(0 == RestoreAndStore(pool, "temperature", 5));
+    CHECK(5 == RestoreAndStore(pool, "temperature", 5));
+    CHECK(10 == RestoreAndStore(pool, "temperature", 0));
+}
+
+static void RecoversTornColumns(ThreadPool &pool)
+{
+    // A crash while appending leaves part of a point in one column
+    {
+        auto file = std::ofstream{Column("temperature") + ".time",
+                                  std::ios::binary | std::ios::app};
+        file.write("abc", 3);
+    }
+    CHECK(10 == RestoreAndStore(pool, "temperature", 0));
+    CHECK(10 * sizeof(std::int64_t) ==
+          std::filesystem::file_size(Column("temperature") + ".time"));
+}
+
+static void FinishesCommittedRewrite(ThreadPool &pool)
+{
+    // A crash after committing a rewrite of 3 points, but before the value
+    // column was renamed
+    auto const column = Column("temperature");
+    WriteTimes(column + ".time", 3);
+    std::ofstream{column + ".value.tmp", std::ios::binary} << std::string(3 * sizeof(float), '\0');
+    std::ofstream{column + ".time.commit"};
+
+    CHECK(3 == RestoreAndStore(pool, "temperature", 0));
+    CHECK(!std::filesystem::exists(column + ".time.commit"));
+    CHECK(!std::filesystem::exists(column + ".value.tmp"));
+}
+
+static void DropsUncommittedRewrite(ThreadPool &pool)
+{
+    auto const column = Column("temperature");
+    std::ofstream{column + ".time.tmp"} << "junk";
+
+    CHECK(3 == RestoreAndStore(pool, "temperature", 0));
+    CHECK(!std::filesystem::exists(column + ".time.tmp"));
+}
+
+static void SeparatesSimilarKeys(ThreadPool &pool)
+{
+    CHECK(0 == RestoreAndStore(pool, "a,b=c", 2));
+    CHECK(0 == RestoreAndStore(pool, "a_b_c", 4));
+    CHECK(2 == RestoreAndStore(pool, "a,b=c", 0));
+    CHECK(4 == RestoreAndStore(pool, "a_b_c", 0));
+}
+
+int main()
+{
+    std::filesystem::remove_all(Directory);
+
+    auto pool = ThreadPool{2};
+    RestoresStoredPoints(pool);
+    RecoversTornColumns(pool);
+    FinishesCommittedRewrite(pool);
+    DropsUncommittedRewrite(pool);
+    SeparatesSimilarKeys(pool);
+
+    std::filesystem::remove_all(Directory);
+    return 0;
+}
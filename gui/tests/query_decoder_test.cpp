@@ -0,0 +1,84 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "check.h"
+#include "query_decoder.h"
+
+static void DecodesColumns()
+{
+    auto series = std::vector<QuerySeries>{};
+    auto errMsg = std::string{};
+    CHECK(QueryDecoder::Decode(
+        R"({"results":[{"statement_id":1,"series":[{"name":"temperature",)"
+        R"("columns":["time","value"],"values":[[1000,1.5],[2000,-2e3]]}]}]})",
+        series, errMsg));
+    CHECK(1 == series.size());
+    CHECK("temperature" == series[0].name);
+    CHECK(1 == series[0].statement);
+    CHECK((std::vector<std::int64_t>{1000, 2000} == series[0].timeStamps));
+    CHECK((std::vector<double>{1.5, -2000.0} == series[0].values));
+}
+
+static void DecodesEscapes()
+{
+    auto series = std::vector<QuerySeries>{};
+    auto errMsg = std::string{};
+    CHECK(QueryDecoder::Decode(
+        R"({"results":[{"statement_id":0,"series":[{"name":"te\"mp","columns":["key"],)"
+        R"("values":[["temperature,device=a\\ b"],["x\u00e9\ud83d\ude00\u20ac\/"]]}]}]})",
+        series, errMsg));
+    CHECK(1 == series.size());
+    CHECK("te\"mp" == series[0].name);
+    CHECK((std::vector<std::string>{"temperature,device=a\\ b",
+                                    "x\xC3\xA9\xF0\x9F\x98\x80\xE2\x82\xAC/"} ==
+           series[0].keys));
+}
+
+static void ReportsErrors()
+{
+    auto series = std::vector<QuerySeries>{};
+    auto errMsg = std::string{};
+    CHECK(!QueryDecoder::Decode(R"({"error":"bad \"q\""})", series, errMsg));
+    CHECK("bad \"q\"" == errMsg);
+
+    // A malformed message is not handed on in parts
+    CHECK(!QueryDecoder::Decode(R"({"error":"bad \u12"})", series, errMsg));
+    CHECK(0 == errMsg.rfind("Malformed query response", 0));
+
+    CHECK(!QueryDecoder::Decode(R"({"results":[{"series":[)", series, errMsg));
+    CHECK(0 == errMsg.rfind("Malformed query response", 0));
+}
+
+static void JoinsChunks()
+{
+    auto series = std::vector<QuerySeries>{};
+    auto errMsg = std::string{};
+    auto decoder = ChunkedDecoder{series};
+
+    // Lines are split at arbitrary points and a series continues over lines
+    auto const first = std::string_view{
+        R"({"results":[{"statement_id":0,"series":[{"name":"a","columns":["time","value"],)"
+        R"("values":[[1,1]],"partial":true}],"partial":true}]})"
+        "\n"};
+    auto const second = std::string_view{
+        R"({"results":[{"statement_id":0,"series":[{"name":"a","columns":["time","value"],)"
+        R"("values":[[2,2]]}]}]})"};
+    CHECK(decoder.Feed(first.substr(0, 10), errMsg));
+    CHECK(decoder.Feed(first.substr(10), errMsg));
+    CHECK(decoder.Feed(second, errMsg));
+    CHECK(decoder.Finish(errMsg));
+
+    CHECK(1 == series.size());
+    CHECK((std::vector<std::int64_t>{1, 2} == series[0].timeStamps));
+    CHECK((std::vector<double>{1.0, 2.0} == series[0].values));
+}
+
+int main()
+{
+    DecodesColumns();
+    DecodesEscapes();
+    ReportsErrors();
+    JoinsChunks();
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "check.h"
+#include "statistics.h"
+#include "time_series.h"
+
+// One point per second from `first` on, valued after their timestamp
+static Samples Seconds(size_t const first, size_t const count)
+{
+    auto samples = Samples{};
+    for (auto i = first; i < first + count; ++i)
+    {
+        samples.Push(static_cast<double>(i), static_cast<double>(i % 1000));
+    }
+    return samples;
+}
+
+static void KeepsMaxPoints()
+{
+    auto ts = TimeSeries{Retention{1000, 0.0}};
+    for (size_t i = 0; i < 100; ++i)
+    {
+        ts.Append(Seconds(i * 1000, 1000));
+    }
+
+    CHECK(1000 == ts.Size());
+    CHECK(99000 == ts.GetEvicted());
+    CHECK(99000.0 == ts.TimeStamp(0));
+    CHECK(99999.0 == ts.TimeStamp(ts.Size() - 1));
+
+    // Chunks of evicted points are freed
+    CHECK(ts.MemoryUsage() < 4 * TimeSeries::ChunkSize * (sizeof(std::uint32_t) + sizeof(float)));
+}
+
+static void KeepsMaxAge()
+{
+    auto ts = TimeSeries{Retention{0, 60.0}};
+    ts.Append(Seconds(0, 10000));
+
+    CHECK(9939.0 == ts.TimeStamp(0));
+    CHECK(9999.0 == ts.TimeStamp(ts.Size() - 1));
+    CHECK(ts.GetEvicted() + ts.Size() == 10000);
+}
+
+static void SnapshotOutlivesEviction()
+{
+    auto ts = TimeSeries{Retention{5000, 0.0}};
+    ts.Append(Seconds(0, 5000));
+    auto const snapshot = ts.GetSnapshot(0, ts.Size());
+    ts.Append(Seconds(5000, 5000));
+
+    auto const samples = snapshot.ToSamples();
+    CHECK(5000 == samples.Size());
+    CHECK(0.0 == samples.TimeStamp(0));
+    CHECK(4999.0 == samples.TimeStamp(4999));
+    CHECK(5000.0 == ts.TimeStamp(0));
+}
+
+static void SummarizesAfterEviction()
+{
+    auto ts = TimeSeries{Retention{300000, 0.0}};
+    for (size_t i = 0; i < 10; ++i)
+    {
+        ts.Append(Seconds(i * 77777, 77777));
+    }
+
+    auto exact = Summary{};
+    auto values = std::vector<double>{};
+    for (size_t i = 0; i < ts.Size(); ++i)
+    {
+        exact.Add(ts.Value(i));
+        values.emplace_back(ts.Value(i));
+    }
+    auto const statistics = ComputeStatistics(ts, ts.TimeStamp(0), ts.TimeStamp(ts.Size() - 1));
+    CHECK(exact.count == statistics.summary.count);
+    CHECK(exact.min == statistics.summary.min);
+    CHECK(exact.max == statistics.summary.max);
+    CHECK(std::abs(exact.mean - statistics.summary.mean) < 1e-6);
+
+    // Percentiles are within the rank error of the digests
+    std::sort(values.begin(), values.end());
+    for (size_t r = 0; r < Statistics::Ranks.size(); ++r)
+    {
+        auto const p = statistics.percentiles[r];
+        auto const rank = static_cast<double>(std::lower_bound(values.begin(), values.end(), p) -
+                                              values.begin()) /
+                          static_cast<double>(values.size());
+        CHECK(std::abs(rank - Statistics::Ranks[r]) < 2.0 / TDigest::Capacity);
+    }
+}
+
+int main()
+{
+    KeepsMaxPoints();
+    KeepsMaxAge();
+    SnapshotOutlivesEviction();
+    SummarizesAfterEviction();
+    return 0;
+}
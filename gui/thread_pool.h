@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Long lived worker threads shared by all background work of the GUI:
+// queries, decoding and downsampling. Results are handed out as futures, so
+// callers poll them with IsFutureDone just like std::async.
+class ThreadPool
+{
+  public:
+    ThreadPool() : ThreadPool(DefaultThreadCount())
+    {
+    }
+
+    explicit ThreadPool(size_t const threadCount)
+    {
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back([this]() { Work(); });
+        }
+    }
+
+    // Tasks that have not started yet are dropped, running ones are waited
+    // for. Their futures report a broken promise.
+    ~ThreadPool()
+    {
+        {
+            auto const lg = std::lock_guard{m};
+            stopping = true;
+            tasks.clear();
+        }
+        cv.notify_all();
+
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    // Queue `f(args...)` to run on one of the workers. Arguments are copied
+    // unless wrapped in std::ref, the same as for std::async.
+    template <typename F, typename... Args>
+    auto Submit(F &&f, Args &&...args) -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        using Result = std::invoke_result_t<F, Args...>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        auto future = task->get_future();
+
+        {
+            auto const lg = std::lock_guard{m};
+            tasks.emplace_back([task]() { (*task)(); });
+        }
+        cv.notify_one();
+
+        return future;
+    }
+
+    // Called on the worker after every task, e.g. to wake up the main loop
+    // so it picks up the result
+    void SetOnTaskDone(std::function<void()> f)
+    {
+        auto const lg = std::lock_guard{m};
+        onTaskDone = std::move(f);
+    }
+
+    // Queries mostly wait on the network, so there are always a few more
+    // workers than the database has connections
+    static size_t DefaultThreadCount()
+    {
+        return std::max(size_t{6}, static_cast<size_t>(std::thread::hardware_concurrency()));
+    }
+
+  private:
+    void Work()
+    {
+        while (true)
+        {
+            auto task = std::function<void()>{};
+            auto done = std::function<void()>{};
+            {
+                auto lock = std::unique_lock{m};
+                cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping)
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                done = onTaskDone;
+            }
+            task();
+
+            if (done)
+            {
+                done();
+            }
+        }
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    std::function<void()> onTaskDone;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
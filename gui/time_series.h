@@ -0,0 +1,1048 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "t_digest.h"
+
+// Bounds for the memory used by a time series. Zero means unbounded.
+struct Retention
+{
+    // Number of points kept
+    size_t maxPoints = 0;
+
+    // Seconds a point is kept, relative to the newest point
+    double maxAge = 0.0;
+};
+
+// Milliseconds since epoch of a timestamp in seconds, the resolution points
+// are stored and compared at
+static std::int64_t Milliseconds(double const seconds)
+{
+    return std::llround(seconds * 1000.0);
+}
+
+// Index range [first, last) of the `size` sorted timestamps accessed through
+// `at` inside of [xMin, xMax] plus one neighbour on either side, so lines
+// continue to the edge of a plot
+template <typename TimeStampAt>
+static std::pair<size_t, size_t> VisibleRange(size_t const size, TimeStampAt const &at,
+                                              double const xMin, double const xMax)
+{
+    auto const lowerBound = [&](size_t lo, double const x, bool const inclusive) {
+        auto hi = size;
+        while (lo < hi)
+        {
+            auto const mid = lo + (hi - lo) / 2;
+            auto const t = at(mid);
+            if (t < x || (inclusive && t == x))
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        return lo;
+    };
+
+    auto first = lowerBound(0, xMin, false);
+    auto last = lowerBound(first, xMax, true);
+    if (first > 0)
+    {
+        --first;
+    }
+    if (last < size)
+    {
+        ++last;
+    }
+
+    return {first, last};
+}
+
+static std::pair<size_t, size_t> VisibleRange(std::vector<double> const &timeStamps,
+                                              double const xMin, double const xMax)
+{
+    return VisibleRange(
+        timeStamps.size(), [&](size_t const i) { return timeStamps[i]; }, xMin, xMax);
+}
+
+// Count, extremes, mean and sum of squared deviations from the mean of a set
+// of values. Sets are merged pairwise, so summaries of blocks combine into the
+// summary of a range.
+struct Summary
+{
+    size_t count = 0;
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void Merge(size_t const n, double const nMin, double const nMax, double const nMean,
+               double const nM2)
+    {
+        if (0 == n)
+        {
+            return;
+        }
+
+        min = 0 == count ? nMin : std::min(min, nMin);
+        max = 0 == count ? nMax : std::max(max, nMax);
+
+        auto const a = static_cast<double>(count);
+        auto const b = static_cast<double>(n);
+        auto const delta = nMean - mean;
+        mean += delta * b / (a + b);
+        m2 += nM2 + delta * delta * a * b / (a + b);
+        count += n;
+    }
+
+    void Add(double const value)
+    {
+        Merge(1, value, value, value, 0.0);
+    }
+
+    // Sample standard deviation
+    double StdDev() const
+    {
+        return count > 1 ? std::sqrt(m2 / static_cast<double>(count - 1)) : 0.0;
+    }
+};
+
+// Level of detail pyramid over a time series. Level 1 summarizes blocks of
+// BaseBlock consecutive points and every level above merges two blocks of the
+// level below. A block holds the min, max and mean value of its points and
+// their sum of squared deviations from the mean, so a plot only has to draw
+// as many blocks as it is wide no matter how many points are visible, and
+// statistics of a range only have to merge a few blocks.
+//
+// Blocks are aligned to the absolute number of points ever appended, so the
+// points of a block follow from its index and points evicted from the front
+// of the series only ever retire whole blocks. Extremes are stored as float
+// like the points, means and squared deviations in double so statistics
+// merged from blocks stay exact. Either way the pyramid is a small fraction
+// of the size of the points.
+//
+// Complete blocks of SketchLevel and above also hold a TDigest of their
+// values for percentiles. A digest is a few hundred bytes for thousands of
+// points, and the levels above merge the digests of the level below, so
+// percentiles of a range merge a few digests too.
+class Pyramid
+{
+  public:
+    static constexpr size_t BaseBlock = 64;
+
+    // Blocks of level 1 wider than this many pixels are not drawn, the raw
+    // points are
+    static constexpr size_t MaxBlockPixels = 4;
+
+    // Lowest level whose blocks get a digest, 8192 points each
+    static constexpr size_t SketchLevel = 8;
+
+    struct Level
+    {
+        std::vector<float> mins;
+        std::vector<float> maxs;
+        std::vector<double> means;
+        std::vector<double> m2s;
+
+        // Absolute number of the block stored at index 0
+        size_t firstBlock = 0;
+
+        // Leading blocks whose points were all evicted from the series
+        size_t dead = 0;
+
+        // Points summarized by the last, possibly incomplete block
+        size_t lastCount = 0;
+
+        size_t Size() const
+        {
+            return mins.size();
+        }
+
+        // Summary of the block at index i holding `count` points
+        Summary Get(size_t const i, size_t const count) const
+        {
+            return {count, mins[i], maxs[i], means[i], m2s[i]};
+        }
+
+        void Push(Summary const &summary)
+        {
+            mins.emplace_back();
+            maxs.emplace_back();
+            means.emplace_back();
+            m2s.emplace_back();
+            Set(Size() - 1, summary);
+        }
+
+        void Set(size_t const i, Summary const &summary)
+        {
+            mins[i] = static_cast<float>(summary.min);
+            maxs[i] = static_cast<float>(summary.max);
+            means[i] = summary.mean;
+            m2s[i] = summary.m2;
+        }
+
+        void Truncate(size_t const size)
+        {
+            mins.resize(size);
+            maxs.resize(size);
+            means.resize(size);
+            m2s.resize(size);
+        }
+
+        void Erase(size_t const blocks)
+        {
+            auto const n = static_cast<std::ptrdiff_t>(blocks);
+            mins.erase(mins.begin(), mins.begin() + n);
+            maxs.erase(maxs.begin(), maxs.begin() + n);
+            means.erase(means.begin(), means.begin() + n);
+            m2s.erase(m2s.begin(), m2s.begin() + n);
+            firstBlock += blocks;
+            dead -= blocks;
+        }
+    };
+
+    // Points summarized by a block of level k >= 1
+    static constexpr size_t BlockSize(size_t const k)
+    {
+        return BaseBlock << (k - 1);
+    }
+
+    // Add a point to the finest level. Coarser levels catch up in Update.
+    void Add(double const value)
+    {
+        if (levels.empty())
+        {
+            levels.emplace_back();
+        }
+
+        auto &level = levels.front();
+        if (0 == level.Size() || BaseBlock == level.lastCount)
+        {
+            level.Push(Summary{});
+            level.lastCount = 0;
+        }
+        auto summary = level.Get(level.Size() - 1, level.lastCount);
+        summary.Add(value);
+        level.Set(level.Size() - 1, summary);
+        level.lastCount = summary.count;
+
+        ++appended;
+
+        // Points go into the digest of their block in batches, all of them
+        // once the block is complete
+        unsketched.emplace_back(static_cast<float>(value));
+        auto const complete = 0 == appended % BlockSize(SketchLevel);
+        if (complete || MaxUnsketched == unsketched.size())
+        {
+            sketching.Add(unsketched);
+            unsketched.clear();
+        }
+        if (complete)
+        {
+            AddSketch(0, appended / BlockSize(SketchLevel) - 1, std::exchange(sketching, {}));
+        }
+    }
+
+    // Bytes allocated for all levels
+    size_t MemoryUsage() const
+    {
+        auto bytes = levels.capacity() * sizeof(Level);
+        for (auto const &level : levels)
+        {
+            bytes += (level.mins.capacity() + level.maxs.capacity()) * sizeof(float) +
+                     (level.means.capacity() + level.m2s.capacity()) * sizeof(double);
+        }
+        for (auto const &level : sketches)
+        {
+            bytes += level.digests.size() * sizeof(TDigest);
+        }
+        return bytes + unsketched.capacity() * sizeof(float);
+    }
+
+    // Bring the coarser levels up to date with the points added since the
+    // last update. Only the trailing block of every level is recomputed.
+    void Update()
+    {
+        // A level is only worth having if its blocks merge at least two
+        // blocks of the level below, counting only the points still held
+        for (size_t k = 2; Needs(k); ++k)
+        {
+            if (levels.size() < k)
+            {
+                levels.emplace_back();
+            }
+            auto const &below = levels[k - 2];
+            auto &level = levels[k - 1];
+
+            // Recompute from the trailing block on, all others are complete
+            if (0 == level.Size())
+            {
+                level.firstBlock = below.firstBlock / 2;
+            }
+            auto const from = 0 == level.Size() ? 0 : level.Size() - 1;
+            level.Truncate(from);
+
+            auto const childSize = BlockSize(k - 1);
+            auto const lastChild = below.firstBlock + below.Size() - 1;
+            for (auto block = level.firstBlock + from; 2 * block <= lastChild; ++block)
+            {
+                auto summary = Summary{};
+                for (auto child = std::max(2 * block, below.firstBlock);
+                     child <= std::min(2 * block + 1, lastChild); ++child)
+                {
+                    auto const i = child - below.firstBlock;
+                    auto const childCount = child == lastChild ? below.lastCount : childSize;
+                    auto const c = below.Get(i, childCount);
+                    summary.Merge(c.count, c.min, c.max, c.mean, c.m2);
+                }
+
+                level.Push(summary);
+                level.lastCount = summary.count;
+            }
+        }
+
+        Compact();
+    }
+
+    // Retire all blocks that only cover points before the absolute index
+    // `evicted`, and the coarsest levels once the points still held fit
+    // into a single block of the level below
+    void Evict(size_t const evicted)
+    {
+        this->evicted = evicted;
+        while (levels.size() > 1 && !Needs(levels.size()))
+        {
+            levels.pop_back();
+        }
+
+        for (size_t k = 1; k <= levels.size(); ++k)
+        {
+            auto &level = levels[k - 1];
+            auto const deadBlocks = evicted / BlockSize(k);
+            level.dead = std::min(deadBlocks, level.firstBlock + level.Size()) -
+                         std::min(deadBlocks, level.firstBlock);
+        }
+
+        // Digests only ever cover complete blocks, one that lost a point is
+        // of no use any more
+        for (size_t j = 0; j < sketches.size(); ++j)
+        {
+            auto &level = sketches[j];
+            auto const size = BlockSize(SketchLevel + j);
+            while (!level.digests.empty() && level.firstBlock * size < evicted)
+            {
+                level.digests.pop_front();
+                ++level.firstBlock;
+            }
+        }
+
+        Compact();
+    }
+
+    // Coarsest level needed so that `points` consecutive points fit into
+    // `pixels` blocks. 0 means the raw points are drawn, which is the case
+    // as long as blocks of level 1 would be wider than MaxBlockPixels.
+    size_t LevelFor(size_t const points, size_t const pixels) const
+    {
+        if (levels.empty() || points * MaxBlockPixels < BaseBlock * pixels)
+        {
+            return 0;
+        }
+
+        auto k = size_t{1};
+        while (k < levels.size() && points / BlockSize(k) > pixels)
+        {
+            ++k;
+        }
+        return k;
+    }
+
+    // Level k >= 1
+    Level const &GetLevel(size_t const k) const
+    {
+        return levels.at(k - 1);
+    }
+
+    // Number of levels above the raw points
+    size_t LevelCount() const
+    {
+        return levels.size();
+    }
+
+    // Digest of the largest complete block starting at the absolute index
+    // `i` that ends at or before `end`, and the number of points it covers.
+    // Null if there is none.
+    std::pair<TDigest const *, size_t> Sketch(size_t const i, size_t const end) const
+    {
+        for (auto j = sketches.size(); j > 0; --j)
+        {
+            auto const &level = sketches[j - 1];
+            auto const size = BlockSize(SketchLevel + j - 1);
+            auto const block = i / size;
+            if (0 == i % size && i + size <= end && block >= level.firstBlock &&
+                block < level.firstBlock + level.digests.size())
+            {
+                return {&level.digests[block - level.firstBlock], size};
+            }
+        }
+        return {nullptr, 0};
+    }
+
+  private:
+    // Points added to `sketching` at once
+    static constexpr size_t MaxUnsketched = 256;
+
+    // Digests of the complete blocks of a level from SketchLevel on
+    struct SketchBlocks
+    {
+        std::deque<TDigest> digests;
+
+        // Absolute number of the block of the first digest
+        size_t firstBlock = 0;
+    };
+
+    // Whether level k >= 2 merges at least two blocks of the level below
+    bool Needs(size_t const k) const
+    {
+        return BlockSize(k - 1) < appended - evicted;
+    }
+
+    // Erasing from the front is linear, so dead blocks are only dropped once
+    // they make up half of a level. The level above still needs the
+    // children of its trailing block.
+    void Compact()
+    {
+        for (size_t k = 1; k <= levels.size(); ++k)
+        {
+            auto &level = levels[k - 1];
+            auto removable = level.dead;
+            if (k < levels.size())
+            {
+                auto const &above = levels[k];
+                auto const needed =
+                    0 == above.Size() ? 0 : 2 * (above.firstBlock + above.Size() - 1);
+                removable = std::min(removable, needed - std::min(needed, level.firstBlock));
+            }
+
+            if (removable > 0 && 2 * removable >= level.Size())
+            {
+                level.Erase(removable);
+            }
+        }
+    }
+
+    // Store the digest of a complete block of sketch level j, counted from
+    // SketchLevel, and merge it with its sibling into the level above once
+    // both are there. Blocks with points evicted before they were complete
+    // get none.
+    void AddSketch(size_t const j, size_t const block, TDigest const &digest)
+    {
+        if (block * BlockSize(SketchLevel + j) < evicted)
+        {
+            return;
+        }
+
+        if (sketches.size() == j)
+        {
+            sketches.emplace_back();
+        }
+        auto &level = sketches[j];
+        if (level.digests.empty())
+        {
+            level.firstBlock = block;
+        }
+        level.digests.push_back(digest);
+
+        if (1 == block % 2 && block > level.firstBlock)
+        {
+            auto merged = level.digests[block - 1 - level.firstBlock];
+            merged.Merge(digest);
+            AddSketch(j + 1, block / 2, merged);
+        }
+    }
+
+    std::vector<Level> levels;
+    size_t appended = 0;
+
+    std::vector<SketchBlocks> sketches;
+
+    // Digest of the block in progress at SketchLevel and the points not
+    // added to it yet
+    TDigest sketching;
+    std::vector<float> unsketched;
+
+    // Absolute index of the oldest point still held
+    size_t evicted = 0;
+};
+
+// Points in chronological order as they come out of the database or a
+// downsampling pass. Appended in bulk to a TimeSeries.
+struct Samples
+{
+    std::vector<double> timeStamps;
+    std::vector<double> values;
+
+    void Push(double const timeStamp, double const value)
+    {
+        timeStamps.emplace_back(timeStamp);
+        values.emplace_back(value);
+    }
+
+    size_t Size() const
+    {
+        return timeStamps.size();
+    }
+
+    bool IsEmpty() const
+    {
+        return timeStamps.empty();
+    }
+
+    double TimeStamp(size_t const i) const
+    {
+        return timeStamps[i];
+    }
+
+    double Value(size_t const i) const
+    {
+        return values[i];
+    }
+
+    // Points [first, last), read the same way as TimeSeries::View
+    class View
+    {
+      public:
+        View(Samples const &samples, size_t const first, size_t const last)
+            : samples(samples), first(first), last(last)
+        {
+        }
+
+        size_t Size() const
+        {
+            return last - first;
+        }
+
+        std::pair<double, double> At(size_t const i) const
+        {
+            return {samples.timeStamps[first + i], samples.values[first + i]};
+        }
+
+      private:
+        Samples const &samples;
+        size_t first;
+        size_t last;
+    };
+
+    View GetView(size_t const first, size_t const last) const
+    {
+        return {*this, first, last};
+    }
+};
+
+// Append-only time series stored in chunks, so appending never moves the
+// points already stored. Values are kept as float and timestamps as
+// millisecond offsets to the first timestamp of their chunk. Chunks start at
+// MinChunkSize points and every chunk holds twice as many as the one before
+// up to ChunkSize, so a short series does not take a full chunk.
+//
+// A Retention drops the oldest points, a chunk is freed once all of its
+// points are gone.
+class TimeSeries
+{
+  public:
+    static constexpr size_t MinChunkSize = 1024;
+    static constexpr size_t ChunkSize = 64 * 1024;
+
+    TimeSeries() = default;
+
+    explicit TimeSeries(Retention const &retention)
+    {
+        SetRetention(retention);
+    }
+
+    void Append(Samples const &samples)
+    {
+        for (size_t i = 0; i < samples.Size(); ++i)
+        {
+            auto const milliseconds = Milliseconds(samples.TimeStamp(i));
+            auto const value = static_cast<float>(samples.Value(i));
+
+            auto *chunk = chunks.empty() ? nullptr : chunks.back().get();
+            if (nullptr == chunk || chunk->capacity == chunk->size ||
+                milliseconds < chunk->base ||
+                milliseconds - chunk->base > std::numeric_limits<std::uint32_t>::max())
+            {
+                auto const start = nullptr == chunk ? evicted : chunk->start + chunk->size;
+                auto const capacity =
+                    nullptr == chunk ? MinChunkSize : std::min(2 * chunk->capacity, ChunkSize);
+                chunks.emplace_back(std::make_shared<Chunk>(capacity));
+                chunk = chunks.back().get();
+                chunk->start = start;
+                chunk->base = milliseconds;
+            }
+
+            chunk->deltas[chunk->size] = static_cast<std::uint32_t>(milliseconds - chunk->base);
+            chunk->values[chunk->size] = value;
+            ++chunk->size;
+            ++count;
+
+            // Index what is stored, not what came in
+            pyramid.Add(static_cast<double>(value));
+
+            if (0 != retention.maxPoints && count > retention.maxPoints)
+            {
+                DropOldest();
+            }
+        }
+        pyramid.Update();
+
+        EvictExpired();
+    }
+
+    // Append only the points newer than the newest one stored, at the
+    // millisecond resolution points are stored in. Used where several
+    // sources may deliver the same points.
+    void AppendNewer(Samples const &samples)
+    {
+        auto first = size_t{0};
+        if (0 != count)
+        {
+            auto const newest = Milliseconds(TimeStamp(count - 1));
+            while (first < samples.Size() && Milliseconds(samples.TimeStamp(first)) <= newest)
+            {
+                ++first;
+            }
+        }
+
+        if (0 == first)
+        {
+            Append(samples);
+            return;
+        }
+
+        auto newer = Samples{};
+        for (auto i = first; i < samples.Size(); ++i)
+        {
+            newer.Push(samples.TimeStamp(i), samples.Value(i));
+        }
+        Append(newer);
+    }
+
+    void SetRetention(Retention const &r)
+    {
+        retention = r;
+
+        while (0 != retention.maxPoints && count > retention.maxPoints)
+        {
+            DropOldest();
+        }
+
+        EvictExpired();
+    }
+
+    Retention const &GetRetention() const
+    {
+        return retention;
+    }
+
+    size_t Size() const
+    {
+        return count;
+    }
+
+    bool IsEmpty() const
+    {
+        return 0 == count;
+    }
+
+    // Number of points ever dropped from the front. Index i of the series is
+    // the absolute index GetEvicted() + i, which does not change when older
+    // points are dropped.
+    size_t GetEvicted() const
+    {
+        return evicted;
+    }
+
+    // Timestamp in seconds of the i-th oldest point
+    double TimeStamp(size_t const i) const
+    {
+        auto const [chunk, offset] = Locate(i);
+        return static_cast<double>(chunk.base + chunk.deltas[offset]) / 1000.0;
+    }
+
+    // Value of the i-th oldest point
+    double Value(size_t const i) const
+    {
+        auto const [chunk, offset] = Locate(i);
+        return static_cast<double>(chunk.values[offset]);
+    }
+
+    Pyramid const &GetPyramid() const
+    {
+        return pyramid;
+    }
+
+    // Summary of the points [first, last), merged from the largest complete
+    // pyramid blocks inside of the range. Only the points at the edges that
+    // no block fits are read one by one.
+    Summary Summarize(size_t const first, size_t const last) const
+    {
+        auto summary = Summary{};
+        auto i = evicted + first;
+        auto const end = evicted + last;
+        while (i < end)
+        {
+            auto k = pyramid.LevelCount();
+            for (; k > 0; --k)
+            {
+                auto const size = Pyramid::BlockSize(k);
+                auto const &level = pyramid.GetLevel(k);
+                auto const block = i / size;
+                if (0 != i % size || i + size > end || block < level.firstBlock ||
+                    block >= level.firstBlock + level.Size())
+                {
+                    continue;
+                }
+
+                auto const j = block - level.firstBlock;
+                if (j + 1 == level.Size() && size != level.lastCount)
+                {
+                    continue;
+                }
+
+                auto const merged = level.Get(j, size);
+                summary.Merge(merged.count, merged.min, merged.max, merged.mean, merged.m2);
+                i += size;
+                break;
+            }
+
+            if (0 == k)
+            {
+                summary.Add(Value(i - evicted));
+                ++i;
+            }
+        }
+        return summary;
+    }
+
+    // Digest of the points [first, last) for percentiles, merged from the
+    // largest complete digests of pyramid blocks inside of the range like
+    // Summarize. The points at the edges that no block fits, less than two
+    // blocks of Pyramid::SketchLevel, are added one by one.
+    TDigest Sketch(size_t const first, size_t const last) const
+    {
+        auto digest = TDigest{};
+        auto points = std::vector<float>{};
+        auto i = evicted + first;
+        auto const end = evicted + last;
+        while (i < end)
+        {
+            auto const [block, size] = pyramid.Sketch(i, end);
+            if (nullptr != block)
+            {
+                digest.Merge(*block);
+                i += size;
+                continue;
+            }
+
+            auto const [chunk, offset] = Locate(i - evicted);
+            points.emplace_back(chunk.values[offset]);
+            ++i;
+        }
+        digest.Add(points);
+        return digest;
+    }
+
+    // Timestamp of the middle point still held of a block of pyramid level k
+    double BlockTimeStamp(size_t const k, size_t const block) const
+    {
+        auto const size = Pyramid::BlockSize(k);
+        auto const first = std::max(block * size, evicted);
+        auto const last = std::min((block + 1) * size, evicted + count);
+        return TimeStamp((first + last) / 2 - evicted);
+    }
+
+    // Bytes allocated for the chunks and the pyramid
+    size_t MemoryUsage() const
+    {
+        auto bytes = pyramid.MemoryUsage();
+        for (auto const &chunk : chunks)
+        {
+            bytes += sizeof(Chunk) +
+                     chunk->capacity * (sizeof(std::uint32_t) + sizeof(float));
+        }
+        return bytes;
+    }
+
+  private:
+    struct Chunk;
+
+  public:
+    // Points [first, last) in the resolution they are stored in, for
+    // sequential reads such as plotting. Reads start at the chunk of the
+    // previous read, so a pass over the view only searches once per chunk.
+    class View
+    {
+      public:
+        View(TimeSeries const &ts, size_t const first, size_t const last)
+            : ts(ts), first(first), last(last)
+        {
+        }
+
+        size_t Size() const
+        {
+            return last - first;
+        }
+
+        // Timestamp in seconds and value of the i-th point of the view
+        std::pair<double, double> At(size_t const i)
+        {
+            auto const absolute = ts.evicted + first + i;
+            if (nullptr == chunk || absolute < chunk->start ||
+                absolute >= chunk->start + chunk->size)
+            {
+                chunk = &ts.Locate(first + i).first;
+            }
+
+            auto const offset = absolute - chunk->start;
+            return {static_cast<double>(chunk->base + chunk->deltas[offset]) / 1000.0,
+                    static_cast<double>(chunk->values[offset])};
+        }
+
+      private:
+        TimeSeries const &ts;
+        size_t first;
+        size_t last;
+        Chunk const *chunk = nullptr;
+    };
+
+    View GetView(size_t const first, size_t const last) const
+    {
+        return {*this, first, last};
+    }
+
+    // Points [first, last) that stay readable on another thread while the
+    // series goes on. It holds on to the chunks it covers, points appended
+    // or evicted later do not touch it.
+    class Snapshot
+    {
+      public:
+        size_t Size() const
+        {
+            return size;
+        }
+
+        // Copy of the points in the resolution they are stored in
+        Samples ToSamples() const
+        {
+            auto samples = Samples{};
+            samples.timeStamps.reserve(size);
+            samples.values.reserve(size);
+            for (auto const &part : parts)
+            {
+                for (auto k = part.begin; k < part.end; ++k)
+                {
+                    samples.Push(static_cast<double>(part.chunk->base + part.chunk->deltas[k]) /
+                                     1000.0,
+                                 static_cast<double>(part.chunk->values[k]));
+                }
+            }
+            return samples;
+        }
+
+        // Reads the points in place, the same way as TimeSeries::View
+        class View
+        {
+          public:
+            explicit View(Snapshot const &snapshot) : snapshot(snapshot)
+            {
+            }
+
+            size_t Size() const
+            {
+                return snapshot.size;
+            }
+
+            // Timestamp in seconds and value of the i-th point. Neighbouring
+            // points are almost always in the same part, so the part is
+            // searched for starting at the one read last.
+            std::pair<double, double> At(size_t const i)
+            {
+                auto const &parts = snapshot.parts;
+                while (i < partFirst)
+                {
+                    --part;
+                    partFirst -= parts[part].end - parts[part].begin;
+                }
+                while (i >= partFirst + parts[part].end - parts[part].begin)
+                {
+                    partFirst += parts[part].end - parts[part].begin;
+                    ++part;
+                }
+
+                auto const &chunk = *parts[part].chunk;
+                auto const offset = parts[part].begin + i - partFirst;
+                return {static_cast<double>(chunk.base + chunk.deltas[offset]) / 1000.0,
+                        static_cast<double>(chunk.values[offset])};
+            }
+
+          private:
+            Snapshot const &snapshot;
+
+            // Part read last and the index of its first point
+            size_t part = 0;
+            size_t partFirst = 0;
+        };
+
+        View GetView() const
+        {
+            return View{*this};
+        }
+
+      private:
+        friend class TimeSeries;
+
+        // Offsets [begin, end) into a chunk, only ever the ones written
+        // before the snapshot was taken
+        struct Part
+        {
+            std::shared_ptr<Chunk const> chunk;
+            size_t begin;
+            size_t end;
+        };
+
+        std::vector<Part> parts;
+        size_t size = 0;
+    };
+
+    Snapshot GetSnapshot(size_t const first, size_t const last) const
+    {
+        auto snapshot = Snapshot{};
+        if (first >= last)
+        {
+            return snapshot;
+        }
+
+        auto const begin = evicted + first;
+        auto const end = evicted + last;
+        for (auto index = ChunkIndex(first); index < chunks.size(); ++index)
+        {
+            auto const &chunk = chunks[index];
+            if (chunk->start >= end)
+            {
+                break;
+            }
+            snapshot.parts.push_back({chunk, std::max(begin, chunk->start) - chunk->start,
+                                      std::min(end, chunk->start + chunk->size) - chunk->start});
+        }
+        snapshot.size = last - first;
+        return snapshot;
+    }
+
+  private:
+    struct Chunk
+    {
+        explicit Chunk(size_t const capacity)
+            : capacity(capacity), deltas(std::make_unique<std::uint32_t[]>(capacity)),
+              values(std::make_unique<float[]>(capacity))
+        {
+        }
+
+        // Absolute index of the first point in the chunk
+        size_t start = 0;
+
+        // Milliseconds since epoch that the deltas are relative to
+        std::int64_t base = 0;
+
+        size_t size = 0;
+        size_t capacity;
+        std::unique_ptr<std::uint32_t[]> deltas;
+        std::unique_ptr<float[]> values;
+    };
+
+    // Chunk and offset into it of the i-th oldest point. Only the last chunk
+    // is partially filled unless a gap in the timestamps did not fit into a
+    // delta, and only the oldest ones are smaller than ChunkSize, so counting
+    // back from the last chunk is almost always right.
+    std::pair<Chunk const &, size_t> Locate(size_t const i) const
+    {
+        auto const &chunk = *chunks[ChunkIndex(i)];
+        return {chunk, evicted + i - chunk.start};
+    }
+
+    // Index into `chunks` of the chunk holding the i-th oldest point
+    size_t ChunkIndex(size_t const i) const
+    {
+        auto const absolute = evicted + i;
+        auto const lastStart = chunks.back()->start;
+
+        auto index = chunks.size() - 1;
+        if (absolute < lastStart)
+        {
+            index -= std::min((lastStart - absolute - 1) / ChunkSize + 1, index);
+        }
+        if (absolute < chunks[index]->start ||
+            absolute >= chunks[index]->start + chunks[index]->size)
+        {
+            auto const it = std::upper_bound(
+                chunks.begin(), chunks.end(), absolute,
+                [](size_t const a, std::shared_ptr<Chunk> const &c) { return a < c->start; });
+            index = static_cast<size_t>(it - chunks.begin()) - 1;
+        }
+        return index;
+    }
+
+    void DropOldest()
+    {
+        --count;
+        ++evicted;
+
+        auto const &front = *chunks.front();
+        if (evicted >= front.start + front.size)
+        {
+            chunks.pop_front();
+        }
+    }
+
+    void EvictExpired()
+    {
+        if (retention.maxAge > 0.0 && 0 != count)
+        {
+            auto const oldest = TimeStamp(count - 1) - retention.maxAge;
+            while (0 != count && TimeStamp(0) < oldest)
+            {
+                DropOldest();
+            }
+        }
+
+        pyramid.Evict(evicted);
+    }
+
+    // Shared with snapshots read on the worker pool. Points of a chunk are
+    // never changed once written, appending only writes past them.
+    std::deque<std::shared_ptr<Chunk>> chunks;
+    size_t count = 0;
+
+    // Points ever dropped from the front, absolute index of the oldest point
+    size_t evicted = 0;
+
+    Retention retention;
+    Pyramid pyramid;
+};
+
+static std::pair<size_t, size_t> VisibleRange(TimeSeries const &ts, double const xMin,
+                                              double const xMax)
+{
+    return VisibleRange(
+        ts.Size(), [&](size_t const i) { return ts.TimeStamp(i); }, xMin, xMax);
+}